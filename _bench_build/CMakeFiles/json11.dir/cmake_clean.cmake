@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/json11.dir/json11.cpp.o"
+  "CMakeFiles/json11.dir/json11.cpp.o.d"
+  "libjson11.a"
+  "libjson11.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/json11.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/json11_bench.dir/bench.cpp.o"
+  "CMakeFiles/json11_bench.dir/bench.cpp.o.d"
+  "json11_bench"
+  "json11_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/json11_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,686 @@
+/*
+ * Rough throughput and allocation benchmarks for json11.
+ *
+ * Build with -DJSON11_BUILD_BENCHMARKS=ON and run json11_bench. Pass a substring of a
+ * benchmark name to run only the matching benchmarks. Every heap allocation made by the
+ * process is counted, so each benchmark also reports allocations per element.
+ */
+#include <json11.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+using namespace json11;
+using std::string;
+
+static size_t allocation_count = 0;
+
+void * operator new(size_t size) {
+    ++allocation_count;
+    if (void * p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+// std::pmr's default resource allocates through the aligned form.
+void * operator new(size_t size, std::align_val_t alignment) {
+    ++allocation_count;
+    const size_t align = static_cast<size_t>(alignment);
+    // aligned_alloc needs a size that is a multiple of the alignment.
+    if (void * p = std::aligned_alloc(align, (size / align + 1) * align))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void * p) noexcept { std::free(p); }
+void operator delete(void * p, size_t) noexcept { std::free(p); }
+void operator delete(void * p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void * p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+// Sink for benchmark results, so the work cannot be optimized away.
+static volatile size_t bench_sink;
+
+/* run(name, bytes, elements, body)
+ *
+ * Repeat body until at least 200ms have passed, then report throughput over 'bytes', and the
+ * time and number of allocations per iteration divided by 'elements'.
+ */
+template <class F>
+static void run(const char * name, size_t bytes, size_t elements, F && body) {
+    using clock = std::chrono::steady_clock;
+    body();
+
+    size_t iterations = 0;
+    const size_t allocations_before = allocation_count;
+    const auto start = clock::now();
+    auto elapsed = clock::duration::zero();
+    do {
+        body();
+        iterations++;
+        elapsed = clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(200));
+
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    const double allocations = static_cast<double>(allocation_count - allocations_before);
+    printf("%-32s %10.1f MB/s %10.1f ns/element %10.3f allocs/element\n", name,
+           static_cast<double>(bytes) * iterations / seconds / 1e6,
+           seconds * 1e9 / iterations / elements,
+           allocations / iterations / elements);
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Inputs
+ */
+
+static string float_array(size_t count) {
+    string out = "[";
+    for (size_t i = 0; i < count; i++) {
+        if (i)
+            out += ", ";
+        out += std::to_string(i * 0.37 - 1000.0);
+    }
+    out += "]";
+    return out;
+}
+
+static string int_array(size_t count) {
+    string out = "[";
+    for (size_t i = 0; i < count; i++) {
+        if (i)
+            out += ", ";
+        out += std::to_string(i * 7 % 100000);
+    }
+    out += "]";
+    return out;
+}
+
+// An array of small records, returning the number of values in *elements.
+static string record_array(size_t count, size_t *elements) {
+    string out = "[";
+    for (size_t i = 0; i < count; i++) {
+        if (i)
+            out += ", ";
+        out += "{\"id\": " + std::to_string(i)
+             + ", \"name\": \"user" + std::to_string(i) + "\""
+             + ", \"email\": \"user" + std::to_string(i) + "@example.com\""
+             + ", \"active\": " + (i % 3 ? "true" : "false")
+             + ", \"scores\": [" + std::to_string(i % 100) + ", " + std::to_string(i * 0.5) + "]}";
+    }
+    out += "]";
+    *elements = 1 + count * 8;
+    return out;
+}
+
+// GeoJSON-style coordinate pairs with full double precision.
+static string coordinate_array(size_t count) {
+    string out = "[";
+    char buf[64];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(buf, sizeof buf, "%s[%.15g, %.15g]", i ? ", " : "",
+                 -122.4194 + i * 1.2345678e-5, 37.7749 - i * 7.654321e-6);
+        out += buf;
+    }
+    out += "]";
+    return out;
+}
+
+// Metric samples mixing timestamps, small integers and short decimals.
+static string metric_array(size_t count) {
+    string out = "[";
+    char buf[128];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(buf, sizeof buf, "%s[%zu, %zu, %.3f, %.2e]", i ? ", " : "",
+                 1700000000 + i, i % 500, i * 0.125 + 0.001, i * 3.5e-4);
+        out += buf;
+    }
+    out += "]";
+    return out;
+}
+
+static string log_messages(size_t count) {
+    string out = "[";
+    for (size_t i = 0; i < count; i++) {
+        if (i)
+            out += ", ";
+        out += "\"request " + std::to_string(i) + " served from cache in "
+             + std::to_string(i % 97) + "ms by worker " + std::to_string(i % 13)
+             + " after upstream revalidation\"";
+        // Every tenth message carries a quoted path and a stack trace.
+        if (i % 10 == 0)
+            out.insert(out.size() - 1, " for \\\"/api/v1/items\\\"\\n  at handler (server.js:42)");
+    }
+    out += "]";
+    return out;
+}
+
+static string wide_object(size_t count) {
+    string out = "{";
+    for (size_t i = 0; i < count; i++) {
+        if (i)
+            out += ", ";
+        out += "\"feature_" + std::to_string(i * 7919 % count) + "\": " + std::to_string(i);
+    }
+    out += "}";
+    return out;
+}
+
+// Records with many fields of mixed types, of which consumers typically read a few.
+static string wide_records(size_t count, size_t fields) {
+    string out = "[";
+    for (size_t i = 0; i < count; i++) {
+        out += i ? ", {" : "{";
+        for (size_t f = 0; f < fields; f++) {
+            out += (f ? ", \"field_" : "\"field_") + std::to_string(f) + "\": ";
+            if (f % 3 == 0)
+                out += std::to_string(i * fields + f);
+            else if (f % 3 == 1)
+                out += "\"value " + std::to_string(f) + " of record " + std::to_string(i) + "\"";
+            else
+                out += "[" + std::to_string(f) + ", 0.5, {\"nested\": true}]";
+        }
+        out += "}";
+    }
+    out += "]";
+    return out;
+}
+
+/* reformat(json, indent)
+ *
+ * Re-space a JSON text: with indent 0, strip all whitespace outside strings; otherwise put
+ * every member and element on its own line, indented by indent spaces per level.
+ */
+static string reformat(const string &json, size_t indent) {
+    string out;
+    size_t depth = 0;
+    bool in_string = false;
+    auto newline = [&] {
+        if (indent) {
+            out += '\n';
+            out.append(depth * indent, ' ');
+        }
+    };
+    for (size_t i = 0; i < json.size(); i++) {
+        const char ch = json[i];
+        if (in_string) {
+            out += ch;
+            if (ch == '\\')
+                out += json[++i];
+            else if (ch == '"')
+                in_string = false;
+            continue;
+        }
+        switch (ch) {
+            case ' ': case '\n': case '\r': case '\t':
+                break;
+            case '"':
+                in_string = true;
+                out += ch;
+                break;
+            case '{': case '[':
+                out += ch;
+                depth++;
+                newline();
+                break;
+            case '}': case ']':
+                depth--;
+                newline();
+                out += ch;
+                break;
+            case ',':
+                out += ch;
+                newline();
+                break;
+            case ':':
+                out += indent ? ": " : ":";
+                break;
+            default:
+                out += ch;
+        }
+    }
+    return out;
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Benchmarks
+ */
+
+static void bench_parse_numbers() {
+    const size_t count = 100000;
+    const string floats = float_array(count);
+    const string ints = int_array(count);
+    string err;
+
+    run("parse float array", floats.size(), count, [&] {
+        bench_sink = Json::parse(floats, err).array_items().size();
+    });
+    run("parse int array", ints.size(), count, [&] {
+        bench_sink = Json::parse(ints, err).array_items().size();
+    });
+
+    const string coordinates = coordinate_array(count / 2);
+    const string metrics = metric_array(count / 4);
+    JsonDocument doc;
+    run("parse coordinates (document)", coordinates.size(), count, [&] {
+        bench_sink = doc.parse(coordinates, err).array_items().size();
+    });
+    run("parse metrics (document)", metrics.size(), count, [&] {
+        bench_sink = doc.parse(metrics, err).array_items().size();
+    });
+}
+
+static void bench_parse_document() {
+    size_t elements;
+    const string records = record_array(20000, &elements);
+    string err;
+
+    run("parse records", records.size(), elements, [&] {
+        bench_sink = Json::parse(records, err).array_items().size();
+    });
+
+    JsonDocument doc;
+    run("parse records (document)", records.size(), elements, [&] {
+        bench_sink = doc.parse(records, err).array_items().size();
+    });
+}
+
+// Sums the "id" members of the records without building any values.
+struct IdSum final : JsonHandler {
+    int64_t sum = 0;
+    bool next_is_id = false;
+
+    bool on_key(std::string_view key) override {
+        next_is_id = key == "id";
+        return true;
+    }
+    bool on_number(const Json &value) override {
+        if (next_is_id)
+            sum += value.int64_value();
+        next_is_id = false;
+        return true;
+    }
+};
+
+static void bench_parse_events() {
+    size_t elements;
+    const string records = record_array(20000, &elements);
+    string err;
+
+    run("sum ids (values)", records.size(), elements, [&] {
+        int64_t sum = 0;
+        const Json json = Json::parse(records, err);
+        for (const Json &record : json.array_items())
+            sum += record["id"].int64_value();
+        bench_sink = sum;
+    });
+    run("sum ids (events)", records.size(), elements, [&] {
+        IdSum handler;
+        Json::parse(records, handler, err);
+        bench_sink = handler.sum;
+    });
+}
+
+static void bench_parse_stream() {
+    // One record per line, as in a log shipped over the network.
+    size_t elements;
+    const string records = record_array(20000, &elements);
+    string lines;
+    string err;
+    const Json json = Json::parse(records, err);
+    for (const Json &record : json.array_items())
+        lines += record.dump() + "\n";
+
+    run("parse lines (parse_multi)", lines.size(), elements, [&] {
+        bench_sink = Json::parse_multi(lines, err).size();
+    });
+    run("parse lines (1500-byte chunks)", lines.size(), elements, [&] {
+        JsonStreamParser parser;
+        Json value;
+        size_t count = 0;
+        for (size_t pos = 0; pos < lines.size(); pos += 1500) {
+            parser.feed(std::string_view(lines).substr(pos, 1500));
+            while (parser.next(value))
+                count++;
+        }
+        parser.finish();
+        while (parser.next(value))
+            count++;
+        bench_sink = count;
+    });
+}
+
+static void bench_parse_wide_objects() {
+    string err;
+    for (size_t count : { 16, 1000, 10000 }) {
+        const string object = wide_object(count);
+        const string name = "parse wide object (" + std::to_string(count) + ")";
+        run(name.c_str(), object.size(), count, [&] {
+            bench_sink = Json::parse(object, err).object_items().size();
+        });
+    }
+}
+
+static void bench_object_lookup() {
+    string err;
+    for (size_t count : { 16, 1000, 10000 }) {
+        const Json object = Json::parse(wide_object(count), err);
+        std::vector<string> keys;
+        for (const auto &kv : object.object_items())
+            keys.push_back(kv.first);
+
+        const string name = "lookup every key (" + std::to_string(count) + ")";
+        run(name.c_str(), 0, count, [&] {
+            size_t sum = 0;
+            for (const auto &key : keys)
+                sum += object[key].int_value();
+            bench_sink = sum;
+        });
+    }
+}
+
+static void bench_literal_lookup() {
+    const Json object = Json::object {
+        { "request_identifier", 1 },
+        { "upstream_latency_ms", 2 },
+        { "downstream_latency_ms", 3 },
+        { "response_status_code", 4 },
+    };
+
+    run("lookup long literal keys", 0, 4, [&] {
+        bench_sink = object["request_identifier"].int_value()
+                   + object["upstream_latency_ms"].int_value()
+                   + object["downstream_latency_ms"].int_value()
+                   + object["response_status_code"].int_value();
+    });
+}
+
+static void bench_parse_whitespace() {
+    size_t elements;
+    const string records = record_array(20000, &elements);
+    string err;
+
+    const struct {
+        const char * name;
+        string text;
+    } inputs[] = {
+        { "parse records (minified)", reformat(records, 0) },
+        { "parse records (indent 2)", reformat(records, 2) },
+        { "parse records (indent 8)", reformat(records, 8) },
+    };
+    for (const auto &input : inputs) {
+        run(input.name, input.text.size(), elements, [&] {
+            bench_sink = Json::parse(input.text, err).array_items().size();
+        });
+    }
+    // Deeply nested data carries long runs of indentation between short tokens.
+    string nested = "1";
+    for (int depth = 0; depth < 8; depth++)
+        nested = "[" + nested + ", " + nested + "]";
+    nested = reformat("[" + nested + ", " + nested + "]", 4);
+    run("parse nested ints (indent 4)", nested.size(), 512, [&] {
+        bench_sink = Json::parse(nested, err).array_items().size();
+    });
+}
+
+static void bench_parse_strings() {
+    const size_t count = 10000;
+    const string messages = log_messages(count);
+
+    string blob = "\"";
+    for (size_t i = 0; i < 1 << 20; i++)
+        blob += "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[i * 31 % 64];
+    blob += "\"";
+    string err;
+
+    run("parse log messages", messages.size(), count, [&] {
+        bench_sink = Json::parse(messages, err).array_items().size();
+    });
+    run("parse base64 blob", blob.size(), 1, [&] {
+        bench_sink = Json::parse(blob, err).string_value().size();
+    });
+}
+
+static void bench_parse_engines() {
+    size_t elements;
+    const string records = record_array(20000, &elements);
+    const size_t count = 10000;
+    const struct {
+        const char * name;
+        string text;
+        size_t elements;
+    } inputs[] = {
+        { "records (minified)", reformat(records, 0), elements },
+        { "records (indent 4)", reformat(records, 4), elements },
+        { "coordinates", coordinate_array(count), count },
+        { "log messages", log_messages(count), count },
+    };
+    JsonParseOptions indexed;
+    indexed.engine = STRUCTURAL_INDEX;
+    string err;
+
+    for (const auto &input : inputs) {
+        const string descent_name = string("parse ") + input.name + " (recursive descent)";
+        run(descent_name.c_str(), input.text.size(), input.elements, [&] {
+            bench_sink = Json::parse(input.text, err).array_items().size();
+        });
+        const string indexed_name = string("parse ") + input.name + " (structural index)";
+        run(indexed_name.c_str(), input.text.size(), input.elements, [&] {
+            bench_sink = Json::parse(input.text, err, indexed).array_items().size();
+        });
+    }
+}
+
+static void bench_lazy_document() {
+    const size_t count = 2000;
+    const string records = wide_records(count, 200);
+    string err;
+
+    run("read 4 of 200 fields (parse)", records.size(), count, [&] {
+        const Json json = Json::parse(records, err);
+        size_t sum = 0;
+        for (const Json &record : json.array_items()) {
+            sum += record["field_3"].int_value() + record["field_40"].string_value().size()
+                 + record["field_120"].int_value() + record["field_197"].array_items().size();
+        }
+        bench_sink = sum;
+    });
+
+    JsonLazyDocument doc;
+    run("read 4 of 200 fields (lazy)", records.size(), count, [&] {
+        doc.parse(records, err);
+        size_t sum = 0;
+        for (const JsonLazyValue record : doc.root().array_items()) {
+            sum += record["field_3"].int_value() + record["field_40"].string_value().size()
+                 + record["field_120"].int_value() + record["field_197"].size();
+        }
+        bench_sink = sum;
+    });
+}
+
+static void bench_projection() {
+    const size_t count = 2000;
+    const string records = wide_records(count, 200);
+    const JsonProjection projection { "/*/field_3", "/*/field_40", "/*/field_197/2" };
+    string err;
+
+    run("project 3 of 200 fields (parse)", records.size(), count, [&] {
+        bench_sink = Json::parse(records, err).array_items().size();
+    });
+    run("project 3 of 200 fields (projection)", records.size(), count, [&] {
+        bench_sink = Json::parse(records, projection, err).array_items().size();
+    });
+}
+
+static void bench_validate() {
+    size_t elements;
+    const string records = record_array(20000, &elements);
+    const size_t count = 10000;
+    const struct {
+        const char * name;
+        string text;
+        size_t elements;
+    } inputs[] = {
+        { "records (minified)", reformat(records, 0), elements },
+        { "records (indent 4)", reformat(records, 4), elements },
+        { "coordinates", coordinate_array(count), count },
+        { "log messages", log_messages(count), count },
+    };
+    string err;
+
+    for (const auto &input : inputs) {
+        const string parse_name = string("parse ") + input.name;
+        run(parse_name.c_str(), input.text.size(), input.elements, [&] {
+            bench_sink = Json::parse(input.text, err).array_items().size();
+        });
+        const string validate_name = string("validate ") + input.name;
+        run(validate_name.c_str(), input.text.size(), input.elements, [&] {
+            bench_sink = Json::validate(input.text, err);
+        });
+    }
+}
+
+// An array of count values nested depth levels deep in arrays or objects.
+static string nested_values(size_t count, size_t depth, bool objects) {
+    string value = "1";
+    for (size_t d = 0; d < depth; d++)
+        value = objects ? "{\"k\": " + value + "}" : "[" + value + "]";
+    string out = "[";
+    for (size_t i = 0; i < count; i++)
+        out += (i ? ", " : "") + value;
+    out += "]";
+    return out;
+}
+
+static void bench_parse_nesting() {
+    const size_t count = 2000;
+    const size_t depth = 150;
+    const string arrays = nested_values(count, depth, false);
+    const string objects = nested_values(count, depth, true);
+    string err;
+
+    run("parse nested arrays (depth 150)", arrays.size(), count * depth, [&] {
+        bench_sink = Json::parse(arrays, err).array_items().size();
+    });
+    run("parse nested objects (depth 150)", objects.size(), count * depth, [&] {
+        bench_sink = Json::parse(objects, err).array_items().size();
+    });
+    run("validate nested arrays (depth 150)", arrays.size(), count * depth, [&] {
+        bench_sink = Json::validate(arrays, err);
+    });
+    run("validate nested objects (depth 150)", objects.size(), count * depth, [&] {
+        bench_sink = Json::validate(objects, err);
+    });
+
+    // Deeper than the call stack could hold with a recursive parser
+    JsonParseOptions options;
+    options.max_depth = 1000000;
+    const string deep = string(options.max_depth, '[') + string(options.max_depth, ']');
+    run("validate nested arrays (depth 1000000)", deep.size(), options.max_depth, [&] {
+        bench_sink = Json::validate(deep, err, options);
+    });
+}
+
+static void bench_dump_numbers() {
+    const size_t count = 100000;
+    string err;
+    const struct {
+        const char * name;
+        Json json;
+    } inputs[] = {
+        { "dump float array", Json::parse(float_array(count), err) },
+        { "dump coordinates", Json::parse(coordinate_array(count / 2), err) },
+        { "dump int array", Json::parse(int_array(count), err) },
+        { "dump metrics", Json::parse(metric_array(count / 4), err) },
+    };
+    for (const auto &input : inputs) {
+        string out;
+        input.json.dump(out);
+        const size_t bytes = out.size();
+        run(input.name, bytes, count, [&] {
+            out.clear();
+            input.json.dump(out);
+            bench_sink = out.size();
+        });
+        printf("%-32s %10zu bytes\n", "", bytes);
+    }
+}
+
+static void bench_dump_strings() {
+    size_t elements;
+    string err;
+    const Json records = Json::parse(record_array(20000, &elements), err);
+    const Json messages = Json::parse(log_messages(10000), err);
+    const struct {
+        const char * name;
+        const Json &json;
+        size_t elements;
+    } inputs[] = {
+        { "dump records", records, elements },
+        { "dump log messages", messages, 10000 },
+    };
+    for (const auto &input : inputs) {
+        string out;
+        input.json.dump(out);
+        run(input.name, out.size(), input.elements, [&] {
+            out.clear();
+            input.json.dump(out);
+            bench_sink = out.size();
+        });
+    }
+
+    // A fresh string grows geometrically; reserving dump_size() first allocates once.
+    run("dump records (new string)", records.dump_size(), elements, [&] {
+        bench_sink = records.dump().size();
+    });
+    run("dump records (reserved)", records.dump_size(), elements, [&] {
+        string out;
+        out.reserve(records.dump_size());
+        records.dump(out);
+        bench_sink = out.size();
+    });
+
+    // Streaming keeps only one buffer of output in memory, whatever the size of the document.
+    run("dump records (sink)", records.dump().size(), elements, [&] {
+        size_t total = 0;
+        records.dump([&](const char *, size_t size) { total += size; });
+        bench_sink = total;
+    });
+
+    string frame(records.dump_size(), '\0');
+    run("dump records (buffer)", frame.size(), elements, [&] {
+        bench_sink = records.dump(&frame[0], frame.size());
+    });
+    run("measure records", frame.size(), elements, [&] {
+        bench_sink = records.dump_size();
+    });
+}
+
+static const struct {
+    const char * name;
+    void (*body)();
+} benchmarks[] = {
+    { "parse_numbers", bench_parse_numbers },
+    { "parse_document", bench_parse_document },
+    { "parse_events", bench_parse_events },
+    { "parse_stream", bench_parse_stream },
+    { "parse_wide_objects", bench_parse_wide_objects },
+    { "object_lookup", bench_object_lookup },
+    { "literal_lookup", bench_literal_lookup },
+    { "parse_whitespace", bench_parse_whitespace },
+    { "parse_strings", bench_parse_strings },
+    { "parse_engines", bench_parse_engines },
+    { "lazy_document", bench_lazy_document },
+    { "projection", bench_projection },
+    { "validate", bench_validate },
+    { "parse_nesting", bench_parse_nesting },
+    { "dump_numbers", bench_dump_numbers },
+    { "dump_strings", bench_dump_strings },
+};
+
+int main(int argc, char **argv) {
+    const char * filter = argc > 1 ? argv[1] : "";
+    for (const auto & bench : benchmarks) {
+        if (std::strstr(bench.name, filter))
+            bench.body();
+    }
+}
@@ -1,30 +1,31 @@
 /* json11
  *
- * json11 is a tiny JSON library for C++11, providing JSON parsing and serialization.
+ * json11 is a tiny JSON library for C++20, providing JSON parsing and serialization.
  *
  * The core object provided by the library is json11::Json. A Json object represents any JSON
- * value: null, bool, number (int or double), string (std::string), array (std::vector), or
- * object (std::map).
+ * value: null, bool, number (integer or double), string (std::string), array
+ * (Json::array, a std::pmr::vector), or object (Json::object, which keeps its members in
+ * insertion order in a std::pmr::vector and indexes the keys of large objects in a hash table).
  *
  * Json objects act like values: they can be assigned, copied, moved, compared for equality or
  * order, etc. There are also helper methods Json::dump, to serialize a Json to a string, and
- * Json::parse (static) to parse a std::string as a Json object.
+ * Json::parse (static) to parse a string as a Json object.
  *
- * Internally, the various types of Json object are represented by the JsonValue class
- * hierarchy.
+ * Internally, null, booleans and numbers are stored inline in the Json itself, while strings,
+ * arrays and objects are represented by the reference-counted JsonValue class hierarchy. Their
+ * storage can come from any std::pmr::memory_resource, such as a JsonDocument's arena.
  *
  * A note on numbers - JSON specifies the syntax of number formatting but not its semantics,
  * so some JSON implementations distinguish between integers and floating-point numbers, while
  * some don't. In json11, we choose the latter. Because some JSON implementations (namely
  * Javascript itself) treat all numbers as the same type, distinguishing the two leads
  * to JSON that will be *silently* changed by a round-trip through those implementations.
- * Dangerous! To avoid that risk, json11 stores all numbers as double internally, but also
- * provides integer helpers.
+ * Dangerous! To avoid that risk, json11 reports every number as the single NUMBER type.
  *
- * Fortunately, double-precision IEEE754 ('double') can precisely store any integer in the
- * range +/-2^53, which includes every 'int' on most systems. (Timestamps often use int64
- * or long long to avoid the Y2038K problem; a double storing microseconds since some epoch
- * will be exact for +/- 275 years.)
+ * Internally, integers that fit in 64 bits are kept exactly, so identifiers and nanosecond
+ * timestamps survive a parse and dump unchanged and can be read back with int64_value() or
+ * uint64_value(). Everything else is stored as a double, which can precisely store any
+ * integer in the range +/-2^53.
  */
 
 /* Copyright (c) 2013 Dropbox, Inc.
@@ -51,10 +52,17 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <memory>
+#include <atomic>
+#include <cstdint>
 #include <initializer_list>
+#include <functional>
+#include <cstdio>
+#include <iosfwd>
+#include <memory_resource>
 #include <stdexcept>
 
 #ifdef _MSC_VER
@@ -69,12 +77,75 @@
     #endif
 #endif
 
+/* JSON11_ATOMIC_REFCOUNT
+ *
+ * Json values share their nodes through an intrusive reference count. By default the count is
+ * atomic so that Json values may be copied and destroyed concurrently from several threads.
+ * Builds that never share Json values across threads can define this to 0 to use plain
+ * counters and drop the atomic operations from every copy and destruction.
+ *
+ * The library and everything that includes this header must agree on the setting. With CMake,
+ * set the JSON11_ATOMIC_REFCOUNT option instead of defining the macro; the json11 target then
+ * passes it on to everything that links against it.
+ */
+#ifndef JSON11_ATOMIC_REFCOUNT
+#define JSON11_ATOMIC_REFCOUNT 1
+#endif
+
 namespace json11 {
 
 enum JsonParse {
     STANDARD, COMMENTS
 };
 
+// What to do when an object being parsed contains the same key more than once. Kept members
+// stay at the position of the key's first occurrence.
+enum JsonDuplicateKeys {
+    KEEP_LAST, KEEP_FIRST, REJECT_DUPLICATES
+};
+
+// How Json::parse reads its input. RECURSIVE_DESCENT reads it a token at a time.
+// STRUCTURAL_INDEX first finds every structural character with vector instructions and then
+// builds values from that index without looking at whitespace again. Both accept the same
+// inputs and report the same errors. Building the values costs the same either way, so
+// STRUCTURAL_INDEX mostly helps whitespace-heavy input and can be slower on long strings, which
+// it reads twice. It applies only to building Json values with the STANDARD strategy;
+// otherwise RECURSIVE_DESCENT is used.
+enum JsonParseEngine {
+    RECURSIVE_DESCENT, STRUCTURAL_INDEX
+};
+
+struct JsonParseOptions {
+    JsonParse strategy = JsonParse::STANDARD;
+    JsonDuplicateKeys duplicate_keys = KEEP_LAST;
+    JsonParseEngine engine = RECURSIVE_DESCENT;
+    // The most arrays and objects a value may be nested in. The parser does not recurse, so
+    // this can be raised freely, but destroying, comparing and dumping Json values still
+    // recurses per level; check very deep input with validate or read it with a JsonHandler.
+    size_t max_depth = 200;
+
+    JsonParseOptions() = default;
+    JsonParseOptions(JsonParse strategy) : strategy(strategy) {}
+};
+
+// How Json::dump lays out arrays and objects. SPACED is the historical format, with a space
+// after each ',' and ':'. COMPACT leaves out all optional whitespace. PRETTY puts each element
+// and member on its own line, indented by JsonDumpOptions::indent spaces per level.
+enum JsonFormat {
+    SPACED, COMPACT, PRETTY
+};
+
+struct JsonDumpOptions {
+    JsonFormat format = SPACED;
+    unsigned indent = 4;
+
+    JsonDumpOptions() = default;
+    JsonDumpOptions(JsonFormat format, unsigned indent = 4) : format(format), indent(indent) {}
+};
+
+// Receives serialized output in pieces, in order, as Json::dump produces it.
+using JsonSink = std::function<void(const char *data, size_t size)>;
+
 class JsonException : public std::runtime_error {
 public:
     template <class T>
@@ -82,6 +153,9 @@ public:
 };
 
 class JsonValue;
+class JsonWriter;
+class JsonHandler;
+class JsonProjection;
 
 class Json final {
 public:
@@ -90,25 +164,49 @@ public:
         NUL, NUMBER, BOOL, STRING, ARRAY, OBJECT
     };
 
-    using array = std::vector<Json>;
+    // Arrays and objects keep their elements in std::pmr containers, so their storage can
+    // come from any memory resource. Default-constructed ones use the default resource.
+    using array = std::pmr::vector<Json>;
 
     class object final {
+    public:
         using value_type = std::pair<std::string, Json>;
-        using iterator = typename std::vector<value_type>::iterator;
-        using const_iterator = typename std::vector<value_type>::const_iterator;
-        std::vector<value_type> m_data;
+        using iterator = typename std::pmr::vector<value_type>::iterator;
+        using const_iterator = typename std::pmr::vector<value_type>::const_iterator;
+        using allocator_type = std::pmr::polymorphic_allocator<value_type>;
+    private:
+        struct Index;
+        std::pmr::vector<value_type> m_data;
+        // Hash index over the keys, built by the first lookup once the object is large enough
+        // and kept up to date by insert and operator[]. Keys must not be modified through
+        // iterators, since the index would not see the change.
+        mutable std::atomic<Index *> m_index { nullptr };
+
+        const Index * index() const;
+        void reset_index();
+        size_t position(std::string_view key) const;
     public:
         object() = default;
         object(const object&);
         object(object&&);
+        ~object();
+        object& operator=(const object&);
+        object& operator=(object&&);
+        explicit object(const allocator_type& alloc) : m_data(alloc) {}
         template <class It>
         object(It first, It last) : m_data(first, last) {}
+        template <class It>
+        object(It first, It last, const allocator_type& alloc) : m_data(first, last, alloc) {}
         object(std::initializer_list<value_type> init);
+        // Take over a list of members as-is. The keys must be unique.
+        explicit object(std::pmr::vector<value_type> &&members) : m_data(std::move(members)) {}
+
+        allocator_type get_allocator() const { return m_data.get_allocator(); }
 
         size_t size() const { return m_data.size(); }
         bool empty() const { return m_data.empty(); }
 
-        Json& operator[](const std::string& key);
+        Json& operator[](std::string_view key);
         iterator begin();
         iterator end();
         const_iterator begin() const;
@@ -116,12 +214,13 @@ public:
         const_iterator end() const;
         const_iterator cend() const;
 
-        iterator find(const std::string& key);
-        const_iterator find(const std::string& key) const;
+        iterator find(std::string_view key);
+        const_iterator find(std::string_view key) const;
 
         std::pair<iterator, bool> insert(const value_type& value);
-        size_t count(const std::string& key) const;
+        size_t count(std::string_view key) const;
 
+        // Compare members in key order, so insertion order does not affect the result.
         bool operator==(const object& other) const;
         bool operator<(const object& other) const;
     };
@@ -131,6 +230,8 @@ public:
     Json(std::nullptr_t) noexcept;  // NUL
     Json(double value);             // NUMBER
     Json(int value);                // NUMBER
+    Json(int64_t value);            // NUMBER
+    Json(uint64_t value);           // NUMBER
     Json(bool value);               // BOOL
     Json(const std::string &value); // STRING
     Json(std::string &&value);      // STRING
@@ -140,8 +241,17 @@ public:
     Json(const object &values);     // OBJECT
     Json(object &&values);          // OBJECT
 
-    template <typename T> requires std::is_integral_v<T>
-    Json(const T& value) : Json(static_cast<double>(value)) {}
+    // Constructors that allocate the value's node from the given memory resource instead of
+    // the global heap. A null resource means the global heap.
+    Json(std::string &&value, std::pmr::memory_resource *resource);
+    Json(array &&values, std::pmr::memory_resource *resource);
+    Json(object &&values, std::pmr::memory_resource *resource);
+
+    template <typename T> requires std::is_integral_v<T> && std::is_signed_v<T>
+    Json(const T& value) : Json(static_cast<int64_t>(value)) {}
+
+    template <typename T> requires std::is_integral_v<T> && std::is_unsigned_v<T>
+    Json(const T& value) : Json(static_cast<uint64_t>(value)) {}
 
     template <class T>
     requires requires(const T& value) { to_json(value); }
@@ -168,6 +278,13 @@ public:
     // Json(bool(some_pointer)) if that behavior is desired.
     Json(void *) = delete;
 
+    // Copying shares the underlying value; moving steals it.
+    Json(const Json &other) noexcept;
+    Json(Json &&other) noexcept;
+    Json &operator=(const Json &other) noexcept;
+    Json &operator=(Json &&other) noexcept;
+    ~Json();
+
     // Accessors
     Type type() const;
 
@@ -179,10 +296,14 @@ public:
     bool is_object() const { return type() == OBJECT; }
 
     // Return the enclosed value if this is a number, 0 otherwise. Note that json11 does not
-    // distinguish between integer and non-integer numbers - number_value() and int_value()
-    // can both be applied to a NUMBER-typed object.
+    // distinguish between integer and non-integer numbers - number_value(), int_value(),
+    // int64_value() and uint64_value() can all be applied to a NUMBER-typed object. The
+    // 64-bit accessors are exact for integers stored as 64-bit values. The integer accessors
+    // clamp values outside the result type's range to its limits and return 0 for NaN.
     double number_value() const;
     int int_value() const;
+    int64_t int64_value() const;
+    uint64_t uint64_value() const;
 
     // Return the enclosed value if this is a boolean, false otherwise.
     bool bool_value() const;
@@ -198,14 +319,20 @@ public:
     // Return a reference to arr[i] if this is an array, Json() otherwise.
     const Json& operator[](size_t i) const;
     Json& operator[](size_t i);
-    // Return a reference to obj[key] if this is an object, Json() otherwise.
-    const Json& operator[](const std::string &key) const;
-    Json& operator[](const std::string& key);
+    // Return a reference to obj[key] if this is an object, Json() otherwise. Keys are taken as
+    // std::string_view, so looking up a literal or a view does not allocate.
+    const Json& operator[](std::string_view key) const;
+    Json& operator[](std::string_view key);
 
     template <class T>
     decltype(auto) as() const {
         if constexpr (std::is_same_v<T, bool>) {
             return this->bool_value();
+        } else if constexpr (std::is_integral_v<T> && sizeof(T) > sizeof(int)) {
+            if constexpr (std::is_signed_v<T>)
+                return this->int64_value();
+            else
+                return this->uint64_value();
         } else if constexpr (std::is_integral_v<T>) {
             return this->int_value();
         } else if constexpr (std::is_floating_point_v<T>) {
@@ -248,45 +375,108 @@ public:
 
     template <class T, class Key>
     decltype(auto) get(Key&& key_or_index) const {
-        const auto value = this->operator[](std::forward<Key>(key_or_index));
+        const auto& value = this->operator[](std::forward<Key>(key_or_index));
         return value.template as<T>();
     }
 
     template <class T, class Key>
     decltype(auto) get(Key&& key_or_index) {
-        const auto value = this->operator[](std::forward<Key>(key_or_index));
+        const auto& value = this->operator[](std::forward<Key>(key_or_index));
         return value.template as<T>();
     }
 
-    // Serialize.
-    void dump(std::string &out) const;
-    std::string dump() const {
+    // Serialize, appending to out. To grow out only once, reserve dump_size() more bytes first.
+    void dump(std::string &out, const JsonDumpOptions &options = {}) const;
+    std::string dump(const JsonDumpOptions &options = {}) const {
         std::string out;
-        dump(out);
+        dump(out, options);
         return out;
     }
 
-    // Parse. If parse fails, return Json() and assign an error message to err.
-    static Json parse(const std::string & in,
+    // Serialize into buffer, which is not NUL-terminated. Return the length of the full output,
+    // like snprintf: if that exceeds capacity, only its first capacity bytes were written.
+    size_t dump(char *buffer, size_t capacity, const JsonDumpOptions &options = {}) const;
+    // Return the exact length of the output of dump with the same options.
+    size_t dump_size(const JsonDumpOptions &options = {}) const;
+
+    // Serialize through a fixed-size buffer that is passed on whenever it fills up, so the
+    // whole output is never held in memory at once. Write errors on a FILE or file descriptor
+    // throw JsonException; a stream reports them through its state as usual.
+    void dump(const JsonSink &sink, const JsonDumpOptions &options = {}) const;
+    void dump(std::FILE *file, const JsonDumpOptions &options = {}) const;
+    void dump(std::ostream &stream, const JsonDumpOptions &options = {}) const;
+    void dump_fd(int fd, const JsonDumpOptions &options = {}) const;
+
+    // Parse. If parse fails, return Json() and assign an error message to err. The input does
+    // not need to be NUL-terminated, so it can point straight into a receive buffer or a
+    // mapped file.
+    static Json parse(std::string_view in,
+                      std::string & err,
+                      const JsonParseOptions & options = {});
+
+    static inline Json parse(const char * data,
+                             size_t size,
+                             std::string & err,
+                             const JsonParseOptions & options = {}) {
+        return parse(std::string_view(data, size), err, options);
+    }
+
+    // Parse, allocating the result's nodes and the storage of its arrays and objects from
+    // resource. The result must not outlive the resource.
+    static Json parse(std::string_view in,
                       std::string & err,
-                      JsonParse strategy = JsonParse::STANDARD);
+                      const JsonParseOptions & options,
+                      std::pmr::memory_resource * resource);
+
+    // Parse, passing the contents of in to handler as a sequence of events instead of building
+    // values, so memory use does not depend on the size of the input. Return true on success.
+    // If the input is malformed or a handler method returns false, return false and assign an
+    // error message to err.
+    static bool parse(std::string_view in,
+                      JsonHandler & handler,
+                      std::string & err,
+                      const JsonParseOptions & options = {});
+
+    // Parse, keeping only the parts of the input that projection selects. The rest of the
+    // input is checked as usual, so the same inputs are accepted as by parse, but none of it
+    // is stored. Duplicate keys are only looked for among the members that are kept.
+    static Json parse(std::string_view in,
+                      const JsonProjection & projection,
+                      std::string & err,
+                      const JsonParseOptions & options = {});
+
+    // Check that in holds a single well-formed value, exactly as parse would, but without
+    // building anything or allocating memory. If it does not, return false, assign an error
+    // message to err and set err_pos to the offset at which parsing stopped, which is just
+    // past the offending character for most errors.
+    static bool validate(std::string_view in,
+                         std::string & err,
+                         size_t & err_pos,
+                         const JsonParseOptions & options = {});
+
+    static inline bool validate(std::string_view in,
+                                std::string & err,
+                                const JsonParseOptions & options = {}) {
+        size_t err_pos;
+        return validate(in, err, err_pos, options);
+    }
 
     // Parse. If parse fails, throw an exception
-    static Json try_parse(const std::string & in, JsonParse strategy = JsonParse::STANDARD);
+    static Json try_parse(std::string_view in, const JsonParseOptions & options = {});
 
     // Parse multiple objects, concatenated or separated by whitespace
     static std::vector<Json> parse_multi(
-        const std::string & in,
+        std::string_view in,
         std::string::size_type & parser_stop_pos,
         std::string & err,
-        JsonParse strategy = JsonParse::STANDARD);
+        const JsonParseOptions & options = {});
 
     static inline std::vector<Json> parse_multi(
-        const std::string & in,
+        std::string_view in,
         std::string & err,
-        JsonParse strategy = JsonParse::STANDARD) {
+        const JsonParseOptions & options = {}) {
         std::string::size_type parser_stop_pos;
-        return parse_multi(in, parser_stop_pos, err, strategy);
+        return parse_multi(in, parser_stop_pos, err, options);
     }
 
     bool operator== (const Json &rhs) const;
@@ -305,22 +495,39 @@ public:
     bool has_shape(const shape & types, std::string & err) const;
 
 private:
-    std::shared_ptr<JsonValue> m_ptr;
+    friend class JsonWriter;
+
+    // Null, booleans and numbers are stored inline; only strings, arrays and objects live in
+    // a reference-counted JsonValue node.
+    enum class Kind : uint8_t {
+        NUL, BOOL, INT, INT64, UINT64, DOUBLE, NODE
+    };
+
+    union Storage {
+        JsonValue *ptr;
+        double number;
+        int integer;
+        int64_t int64;
+        uint64_t uint64;
+        bool boolean;
+    };
+
+    // Order two numbers: exactly if both are integers, as doubles otherwise.
+    int compare_numbers(const Json &other) const;
+
+    Storage m_value;
+    Kind m_kind;
 };
 
 // Internal class hierarchy - JsonValue objects are not exposed to users of this API.
 class JsonValue {
 protected:
     friend class Json;
-    friend class JsonInt;
-    friend class JsonDouble;
+    friend class JsonWriter;
     virtual Json::Type type() const = 0;
     virtual bool equals(const JsonValue * other) const = 0;
     virtual bool less(const JsonValue * other) const = 0;
-    virtual void dump(std::string &out) const = 0;
-    virtual double number_value() const;
-    virtual int int_value() const;
-    virtual bool bool_value() const;
+    virtual void dump(JsonWriter &out) const = 0;
     virtual const std::string &string_value() const;
     virtual const Json::array &array_items() const;
     virtual Json::array &array_items();
@@ -328,9 +535,352 @@ protected:
     virtual Json &operator[](size_t i);
     virtual const Json::object &object_items() const;
     virtual Json::object &object_items();
-    virtual const Json &operator[](const std::string &key) const;
-    virtual Json &operator[](const std::string &key);
+    virtual const Json &operator[](std::string_view key) const;
+    virtual Json &operator[](std::string_view key);
     virtual ~JsonValue() {}
+
+    JsonValue() = default;
+    JsonValue(const JsonValue &) = delete;
+    JsonValue &operator=(const JsonValue &) = delete;
+
+private:
+    template <class Node, class... Args>
+    static JsonValue *make(std::pmr::memory_resource *resource, Args &&... args);
+
+    void retain() const noexcept;
+    void release() const noexcept;
+    void destroy() const noexcept;
+
+#if JSON11_ATOMIC_REFCOUNT
+    mutable std::atomic<uint32_t> m_refcount { 1 };
+#else
+    mutable uint32_t m_refcount = 1;
+#endif
+    // Size of the node, or 0 if it is on the global heap. Nodes allocated from a memory
+    // resource are preceded by a pointer to the resource, so that global heap nodes need not
+    // carry one.
+    uint32_t m_size = 0;
+};
+
+/* JsonHandler
+ *
+ * Receives a JSON text from Json::parse as a sequence of events, in document order: values,
+ * the start and end of each array and object, and the key before each object member. Each
+ * method returns true to continue, or false to stop the parse. The default implementations
+ * accept everything.
+ *
+ * Strings and keys are passed as views that are only valid during the call. Numbers are
+ * passed as Json values, which hold them inline. Duplicate keys are passed on as they occur;
+ * JsonParseOptions::duplicate_keys only applies when building values.
+ */
+class JsonHandler {
+public:
+    virtual ~JsonHandler() = default;
+
+    virtual bool on_null() { return true; }
+    virtual bool on_bool(bool) { return true; }
+    virtual bool on_number(const Json &) { return true; }
+    virtual bool on_string(std::string_view) { return true; }
+    virtual bool on_key(std::string_view) { return true; }
+    virtual bool start_array() { return true; }
+    virtual bool end_array() { return true; }
+    virtual bool start_object() { return true; }
+    virtual bool end_object() { return true; }
+};
+
+/* JsonDocument
+ *
+ * A parsed JSON document whose nodes, arrays and objects are allocated from an arena owned by
+ * the document.
+ * Destroying, clearing or re-parsing the document releases the arena in bulk. The arena is
+ * kept between parses, so once it has grown to fit the documents being parsed, later parses
+ * reuse it instead of allocating nodes one at a time.
+ *
+ * Json values obtained from a document share its storage and must not outlive its contents.
+ * That includes copies: a copy keeps the nodes it refers to alive by reference count, but their
+ * memory still belongs to the arena, so every copy is left dangling once the document is
+ * cleared, parsed into again or destroyed. Debug builds assert that no such copies remain
+ * at those points.
+ */
+class JsonDocument final {
+public:
+    JsonDocument();
+    ~JsonDocument();
+    JsonDocument(const JsonDocument &) = delete;
+    JsonDocument &operator=(const JsonDocument &) = delete;
+
+    // Parse in, replacing the previous contents of the document. If parse fails, return
+    // Json() and assign an error message to err.
+    const Json &parse(std::string_view in,
+                      std::string &err,
+                      const JsonParseOptions &options = {});
+
+    // The most recently parsed value, or Json() if there is none.
+    const Json &root() const { return m_root; }
+
+    // Release the document's contents, keeping the arena for reuse.
+    void clear();
+
+private:
+    struct Arena;
+    std::unique_ptr<Arena> m_arena;
+    Json m_root;
+};
+
+/* JsonStreamParser
+ *
+ * Parses a sequence of JSON values, concatenated or separated by whitespace, from input that
+ * arrives in chunks. Values are delimited as Json::parse_multi delimits them, so "3-0" is the
+ * numbers 3 and -0 and "truefalse" is two literals. Unlike parse_multi, input that holds no
+ * values, only whitespace or comments, is an empty sequence rather than an error.
+ *
+ * Chunks may split the input anywhere, including inside strings, escapes and numbers. Each
+ * chunk is scanned once as it is fed, and each value is parsed as soon as its last byte
+ * arrives. Only the unfinished value at the end of the input so far is buffered, so memory
+ * use is bounded by the largest value rather than by the whole input.
+ *
+ * A top-level number is only known to be complete once the next byte arrives, or at finish().
+ */
+class JsonStreamParser final {
+public:
+    explicit JsonStreamParser(const JsonParseOptions &options = {});
+
+    // Add the next chunk of input. Return false if the input is known to be malformed; the
+    // values completed before the error can still be taken with next().
+    bool feed(std::string_view chunk);
+    // Mark the end of the input. Return false if it is malformed, including if it ended in
+    // the middle of a value.
+    bool finish();
+
+    // Move the next completed value into value and return true, or return false if no
+    // value is ready yet.
+    bool next(Json &value);
+
+    bool failed() const { return !m_error.empty(); }
+    // Why the input is malformed, or empty if it is not known to be.
+    const std::string &error() const { return m_error; }
+
+private:
+    enum class State : uint8_t {
+        BETWEEN,            // between top-level values
+        VALUE,              // in an array or object, outside strings and comments
+        STRING,
+        STRING_ESCAPE,      // after a backslash in a string
+        LITERAL,            // in a top-level true, false or null
+        NUMBER_INTEGER,     // in a top-level number's sign or integer part
+        NUMBER_FRACTION,
+        NUMBER_EXPONENT,
+        SLASH,              // after a '/' that may start a comment
+        LINE_COMMENT,
+        BLOCK_COMMENT,
+        BLOCK_COMMENT_STAR, // after a '*' in a block comment
+    };
+
+    void scan(std::string_view data);
+    bool complete(std::string_view data, size_t end);
+    void end_comment();
+
+    const JsonParseOptions m_options;
+    // The unfinished value at the end of the input so far, and how much of it was scanned.
+    std::string m_buffer;
+    size_t m_scanned = 0;
+    // Where the current value or top-level comment starts, or npos.
+    size_t m_value_start = std::string::npos;
+    size_t m_depth = 0;
+    State m_state = State::BETWEEN;
+    bool m_finished = false;
+    std::string m_error;
+    // Completed values, of which the first m_next have been taken.
+    std::vector<Json> m_values;
+    size_t m_next = 0;
+};
+
+class JsonLazyDocument;
+
+/* JsonProjection
+ *
+ * A compiled set of JSON Pointers (RFC 6901), such as "/user/id", selecting the parts of a
+ * document that Json::parse with a projection keeps. A "*" segment matches every member of
+ * an object or element of an array. The empty pointer selects the whole document.
+ *
+ * The result holds each selected value whole, inside the objects and arrays on its path.
+ * Those keep only their selected members and elements, in input order, so the elements of an
+ * array may move down to fill the gaps. Objects and arrays on a path are kept even when
+ * nothing in them is selected; scalars are kept only where a pointer ends.
+ *
+ * Throws JsonException if a pointer is malformed.
+ */
+class JsonProjection final {
+public:
+    // The compiled pointers, as a tree of segments. Defined in json11.cpp.
+    struct Node;
+
+    JsonProjection(std::initializer_list<std::string_view> pointers);
+    explicit JsonProjection(const std::vector<std::string> &pointers);
+    JsonProjection(JsonProjection &&) noexcept;
+    JsonProjection &operator=(JsonProjection &&) noexcept;
+    ~JsonProjection();
+
+private:
+    friend class Json;
+    void add(std::string_view pointer);
+
+    std::unique_ptr<Node> m_root;
+};
+
+/* JsonLazyValue
+ *
+ * A value in a JsonLazyDocument, decoded only when one of its accessors is called. The
+ * accessors mirror Json's, but return strings and looked-up values by value. Like Json's,
+ * they throw JsonException if the value has the wrong type or the element or member does not
+ * exist, and also if the part of the input they read turns out to be malformed. type() only
+ * looks at the value's first character. Looking up an element or member walks the array or
+ * object from its start, jumping over the values before it without decoding them; a key that
+ * occurs more than once finds its first member.
+ *
+ * A default-constructed value is null. Values refer to their document and must not outlive
+ * it.
+ */
+class JsonLazyValue final {
+public:
+    // Iterates over the elements of an array or the values of an object's members.
+    class iterator final {
+    public:
+        JsonLazyValue operator*() const { return JsonLazyValue(m_doc, m_value); }
+        iterator &operator++();
+        bool operator==(const iterator &other) const { return m_value == other.m_value; }
+
+    private:
+        friend class JsonLazyValue;
+        iterator(const JsonLazyDocument *doc, uint32_t value, bool object)
+            : m_doc(doc), m_value(value), m_object(object) {}
+
+        const JsonLazyDocument *m_doc;
+        // The current element or member value, or npos at the end.
+        uint32_t m_value;
+        bool m_object;
+    };
+
+    struct items {
+        iterator first;
+        iterator last;
+        iterator begin() const { return first; }
+        iterator end() const { return last; }
+    };
+
+    JsonLazyValue() = default;
+
+    Json::Type type() const;
+
+    bool is_null()   const { return type() == Json::NUL; }
+    bool is_number() const { return type() == Json::NUMBER; }
+    bool is_bool()   const { return type() == Json::BOOL; }
+    bool is_string() const { return type() == Json::STRING; }
+    bool is_array()  const { return type() == Json::ARRAY; }
+    bool is_object() const { return type() == Json::OBJECT; }
+
+    double number_value() const;
+    int int_value() const;
+    int64_t int64_value() const;
+    uint64_t uint64_value() const;
+    bool bool_value() const;
+    std::string string_value() const;
+
+    items array_items() const;
+    // The values of the members; key() gives the key of each.
+    items object_items() const;
+    // The key of this value, which must be an object member.
+    std::string key() const;
+    // The number of elements or members of an array or object.
+    size_t size() const;
+
+    JsonLazyValue operator[](size_t i) const;
+    JsonLazyValue operator[](std::string_view key) const;
+
+    // Decode the whole value, checking it as Json::parse would.
+    Json decode() const;
+    // The value's text in the input.
+    std::string_view text() const;
+
+    template <class T>
+    decltype(auto) as() const {
+        if constexpr (std::is_same_v<T, bool>) {
+            return this->bool_value();
+        } else if constexpr (std::is_integral_v<T> && sizeof(T) > sizeof(int)) {
+            if constexpr (std::is_signed_v<T>)
+                return this->int64_value();
+            else
+                return this->uint64_value();
+        } else if constexpr (std::is_integral_v<T>) {
+            return this->int_value();
+        } else if constexpr (std::is_floating_point_v<T>) {
+            return this->number_value();
+        } else if constexpr (std::is_constructible_v<std::string, T>) {
+            return this->string_value();
+        } else if constexpr (std::is_same_v<T, Json>) {
+            return this->decode();
+        } else if constexpr (std::is_default_constructible_v<T> && requires(const Json& json, T& value) { from_json(json, value); }) {
+            T value;
+            from_json(this->decode(), value);
+            return value;
+        }
+    }
+
+    template <class T, class Key>
+    decltype(auto) get(Key&& key_or_index) const {
+        return this->operator[](std::forward<Key>(key_or_index)).template as<T>();
+    }
+
+private:
+    friend class JsonLazyDocument;
+    static constexpr uint32_t npos = ~uint32_t(0);
+
+    JsonLazyValue(const JsonLazyDocument *doc, uint32_t index) : m_doc(doc), m_index(index) {}
+
+    char token(uint32_t k) const;
+    uint32_t skip(uint32_t k) const;
+    uint32_t first(char open) const;
+    uint32_t member_value(uint32_t key) const;
+    uint32_t next_element(uint32_t k, bool object) const;
+    Json scalar() const;
+
+    const JsonLazyDocument *m_doc = nullptr;
+    // Position of the value in the document's structural index.
+    uint32_t m_index = npos;
+};
+
+/* JsonLazyDocument
+ *
+ * A JSON document that is indexed when it is parsed but only decoded as its values are
+ * accessed, through root(). Parsing finds the position of every structural character with
+ * the same vectorized pass as the STRUCTURAL_INDEX engine and matches up brackets, so that
+ * lookups can jump over whole arrays and objects. Nothing else is checked until it is
+ * accessed; use Json::parse for input that must be checked in full.
+ *
+ * The document refers to the input rather than copying it, so the input must outlive it.
+ */
+class JsonLazyDocument final {
+public:
+    JsonLazyDocument() = default;
+    JsonLazyDocument(const JsonLazyDocument &) = delete;
+    JsonLazyDocument &operator=(const JsonLazyDocument &) = delete;
+
+    // Index in, replacing the previous contents of the document. If the input ends inside a
+    // string, its brackets do not match or it holds more than one value, return false and
+    // assign an error message to err.
+    bool parse(std::string_view in, std::string &err);
+
+    // The top-level value, or null if there is none.
+    JsonLazyValue root() const;
+
+private:
+    friend class JsonLazyValue;
+
+    std::string_view m_input;
+    // Positions of the structural characters and values, and for each, the position in
+    // m_index just past the value that starts there.
+    std::vector<uint32_t> m_index;
+    std::vector<uint32_t> m_next;
 };
 
 } // namespace json11
@@ -20,125 +20,725 @@
  */
 
 #include <json11.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <charconv>
 #include <cmath>
 #include <cstdlib>
+#include <cerrno>
+#include <climits>
 #include <cstdio>
+#include <cstring>
 #include <limits>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/* JSON11_NO_SIMD
+ *
+ * The scanning loops in the parser and serializer have SSE2 and AVX2 versions on x86, picked
+ * at runtime according to what the CPU supports. Define JSON11_NO_SIMD to build only the
+ * portable ones.
+ */
+#if !defined(JSON11_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) \
+                                 || (defined(__i386__) && defined(__SSE2__)))
+#define JSON11_SIMD_X86 1
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define JSON11_SIMD_AVX2 1
+#endif
+#endif
 
 namespace json11 {
 
-static const int max_depth = 200;
-
 using std::string;
 using std::vector;
-using std::map;
-using std::make_shared;
 using std::initializer_list;
 using std::move;
 
-/* Helper for representing null - just a do-nothing struct, plus comparison
- * operators so the helpers in JsonValue work. We can't use nullptr_t because
- * it may not be orderable.
+/* * * * * * * * * * * * * * * * * * * *
+ * Vectorized scanning
+ *
+ * Each kernel has a portable version and, on x86, SSE2 and AVX2 versions. kernels() picks the
+ * best set the CPU supports the first time it is called.
+ */
+
+static inline bool is_whitespace(char ch) {
+    return ch == ' ' || ch == '\r' || ch == '\n' || ch == '\t';
+}
+
+/* skip_whitespace(p, n)
+ *
+ * Return the number of whitespace characters at the start of the n bytes at p.
+ */
+static size_t skip_whitespace_scalar(const char *p, size_t n) {
+    size_t k = 0;
+    while (k < n && is_whitespace(p[k]))
+        k++;
+    return k;
+}
+
+#if JSON11_SIMD_X86
+static size_t skip_whitespace_sse2(const char *p, size_t n) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i tab = _mm_set1_epi8('\t');
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k));
+        const __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, cr)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, tab)));
+        const unsigned other = ~static_cast<unsigned>(_mm_movemask_epi8(ws)) & 0xFFFF;
+        if (other)
+            return k + std::countr_zero(other);
+    }
+    return k + skip_whitespace_scalar(p + k, n - k);
+}
+#endif
+
+/* scan_string(p, n)
+ *
+ * Return the number of characters at the start of the n bytes at p that can be copied into
+ * a string as they are: everything but '"', '\\' and control characters.
+ */
+static size_t scan_string_scalar(const char *p, size_t n) {
+    size_t k = 0;
+    while (k < n && p[k] != '"' && p[k] != '\\' && static_cast<uint8_t>(p[k]) >= 0x20)
+        k++;
+    return k;
+}
+
+#if JSON11_SIMD_X86
+static size_t scan_string_sse2(const char *p, size_t n) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k));
+        const __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+        if (mask)
+            return k + std::countr_zero(mask);
+    }
+    return k + scan_string_scalar(p + k, n - k);
+}
+#endif
+
+/* scan_escape(p, n)
+ *
+ * Return the number of characters at the start of the n bytes at p that can be written into
+ * a JSON string as they are. This is what scan_string accepts, minus the 0xE2 lead byte of
+ * U+2028 and U+2029, which the serializer escapes.
+ */
+static size_t scan_escape_scalar(const char *p, size_t n) {
+    size_t k = 0;
+    while (k < n && p[k] != '"' && p[k] != '\\' && static_cast<uint8_t>(p[k]) >= 0x20
+           && static_cast<uint8_t>(p[k]) != 0xe2)
+        k++;
+    return k;
+}
+
+#if JSON11_SIMD_X86
+static size_t scan_escape_sse2(const char *p, size_t n) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    const __m128i separator = _mm_set1_epi8(static_cast<char>(0xe2));
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k));
+        const __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk),
+                         _mm_cmpeq_epi8(chunk, separator)));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+        if (mask)
+            return k + std::countr_zero(mask);
+    }
+    return k + scan_escape_scalar(p + k, n - k);
+}
+#endif
+
+#if JSON11_SIMD_AVX2
+__attribute__((target("avx2")))
+static size_t scan_string_avx2(const char *p, size_t n) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    size_t k = 0;
+    for (; k + 32 <= n; k += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k));
+        const __m256i special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk));
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(special));
+        if (mask)
+            return k + std::countr_zero(mask);
+    }
+    // Clear the upper halves before the tail runs legacy SSE code, which would otherwise
+    // stall on the transition.
+    _mm256_zeroupper();
+    return k + scan_string_sse2(p + k, n - k);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_escape_avx2(const char *p, size_t n) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    const __m256i separator = _mm256_set1_epi8(static_cast<char>(0xe2));
+    size_t k = 0;
+    for (; k + 32 <= n; k += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k));
+        const __m256i special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk),
+                            _mm256_cmpeq_epi8(chunk, separator)));
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(special));
+        if (mask)
+            return k + std::countr_zero(mask);
+    }
+    _mm256_zeroupper();
+    return k + scan_escape_sse2(p + k, n - k);
+}
+
+__attribute__((target("avx2")))
+static size_t skip_whitespace_avx2(const char *p, size_t n) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    size_t k = 0;
+    for (; k + 32 <= n; k += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k));
+        const __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, cr)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, lf), _mm256_cmpeq_epi8(chunk, tab)));
+        const uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(ws));
+        if (other)
+            return k + std::countr_zero(other);
+    }
+    _mm256_zeroupper();
+    return k + skip_whitespace_sse2(p + k, n - k);
+}
+#endif
+
+/* classify(p, masks)
+ *
+ * Classify the 64 bytes at p for the structural index, setting bit k of each mask if byte k
+ * is of that class.
  */
-struct NullStruct {
-    bool operator==(NullStruct) const { return true; }
-    bool operator<(NullStruct) const { return false; }
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    // { } [ ] : and ,
+    uint64_t op;
+    uint64_t whitespace;
+};
+
+[[maybe_unused]] static void classify_scalar(const char *p, BlockMasks &masks) {
+    masks = {};
+    for (unsigned k = 0; k < 64; k++) {
+        const uint64_t bit = uint64_t(1) << k;
+        switch (p[k]) {
+        case '"': masks.quote |= bit; break;
+        case '\\': masks.backslash |= bit; break;
+        case '{': case '}': case '[': case ']': case ':': case ',': masks.op |= bit; break;
+        case ' ': case '\r': case '\n': case '\t': masks.whitespace |= bit; break;
+        }
+    }
+}
+
+#if JSON11_SIMD_X86
+static void classify_sse2(const char *p, BlockMasks &masks) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    // '[' and ']' are '{' and '}' with bit 0x20 clear
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i tab = _mm_set1_epi8('\t');
+    masks = {};
+    for (unsigned k = 0; k < 64; k += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k));
+        const __m128i folded = _mm_or_si128(chunk, case_bit);
+        const __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma)));
+        const __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, cr)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, tab)));
+        masks.quote |= uint64_t(unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)))) << k;
+        masks.backslash |=
+            uint64_t(unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)))) << k;
+        masks.op |= uint64_t(unsigned(_mm_movemask_epi8(op))) << k;
+        masks.whitespace |= uint64_t(unsigned(_mm_movemask_epi8(ws))) << k;
+    }
+}
+#endif
+
+#if JSON11_SIMD_AVX2
+__attribute__((target("avx2")))
+static void classify_avx2(const char *p, BlockMasks &masks) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    masks = {};
+    for (unsigned k = 0; k < 64; k += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k));
+        const __m256i folded = _mm256_or_si256(chunk, case_bit);
+        const __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, comma)));
+        const __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, cr)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, lf), _mm256_cmpeq_epi8(chunk, tab)));
+        masks.quote |=
+            uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote)))) << k;
+        masks.backslash |=
+            uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash)))) << k;
+        masks.op |= uint64_t(uint32_t(_mm256_movemask_epi8(op))) << k;
+        masks.whitespace |= uint64_t(uint32_t(_mm256_movemask_epi8(ws))) << k;
+    }
+    _mm256_zeroupper();
+}
+#endif
+
+struct Kernels {
+    size_t (*skip_whitespace)(const char *p, size_t n);
+    size_t (*scan_string)(const char *p, size_t n);
+    size_t (*scan_escape)(const char *p, size_t n);
+    void (*classify)(const char *p, BlockMasks &masks);
 };
 
+static Kernels select_kernels() {
+#if JSON11_SIMD_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return { skip_whitespace_avx2, scan_string_avx2, scan_escape_avx2, classify_avx2 };
+#endif
+#if JSON11_SIMD_X86
+    return { skip_whitespace_sse2, scan_string_sse2, scan_escape_sse2, classify_sse2 };
+#else
+    return { skip_whitespace_scalar, scan_string_scalar, scan_escape_scalar, classify_scalar };
+#endif
+}
+
+static const Kernels & kernels() {
+    static const Kernels k = select_kernels();
+    return k;
+}
+
 /* * * * * * * * * * * * * * * * * * * *
  * Serialization
  */
 
-static void dump(NullStruct, string &out) {
-    out += "null";
-}
+/* JsonWriter
+ *
+ * Collects serialized output in a buffer. Writes that fit in the buffer are a bounds check
+ * and a copy; when it fills up, make_room() grows it (StringWriter), hands its contents to a
+ * sink (SinkWriter) or starts discarding (BufferWriter). The writer also lays out the
+ * punctuation between values according to the dump options.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(const JsonDumpOptions &options) : m_options(options) {}
+    virtual ~JsonWriter() = default;
+    JsonWriter(const JsonWriter &) = delete;
+    JsonWriter &operator=(const JsonWriter &) = delete;
+
+    // The number of bytes that can be written at the cursor before the buffer is full. Code
+    // that formats in place checks this, and follows with advance() by the bytes it wrote.
+    size_t room() const { return m_end - m_cur; }
+    char *cursor() { return m_cur; }
+    void advance(size_t n) { m_cur += n; }
+
+    void put(char ch) {
+        if (m_cur == m_end)
+            make_room();
+        *m_cur++ = ch;
+    }
+    void write(const char *p, size_t n) {
+        while (room() < n) {
+            // Fill what is left of the buffer, so that output stays in order and a sink sees
+            // full buffers.
+            const size_t k = room();
+            if (k)
+                std::memcpy(m_cur, p, k);
+            m_cur += k;
+            p += k;
+            n -= k;
+            make_room();
+        }
+        if (n)
+            std::memcpy(m_cur, p, n);
+        m_cur += n;
+    }
+    void fill(char ch, size_t n) {
+        while (room() < n) {
+            const size_t k = room();
+            std::memset(m_cur, ch, k);
+            m_cur += k;
+            n -= k;
+            make_room();
+        }
+        std::memset(m_cur, ch, n);
+        m_cur += n;
+    }
+    template <size_t N>
+    void literal(const char (&text)[N]) { write(text, N - 1); }
+
+    void value(const Json &json);
 
-static void dump(double value, string &out) {
-    if (std::isfinite(value)) {
-        char buf[32];
-        snprintf(buf, sizeof buf, "%.17g", value);
-        out += buf;
+    // Open an array or object, and start its element or member number 'index'.
+    void open(char bracket) {
+        put(bracket);
+        m_depth++;
+    }
+    void element(size_t index) {
+        if (index) {
+            if (m_options.format == SPACED)
+                literal(", ");
+            else
+                put(',');
+        }
+        if (m_options.format == PRETTY)
+            newline();
+    }
+    void colon() {
+        if (m_options.format == COMPACT)
+            put(':');
+        else
+            literal(": ");
+    }
+    void close(char bracket, bool empty) {
+        m_depth--;
+        if (m_options.format == PRETTY && !empty)
+            newline();
+        put(bracket);
+    }
+
+protected:
+    // Make room at the cursor once the buffer is full, updating m_begin, m_cur and m_end.
+    virtual void make_room() = 0;
+
+    char *m_begin = nullptr;
+    char *m_cur = nullptr;
+    char *m_end = nullptr;
+
+private:
+    void newline() {
+        put('\n');
+        fill(' ', size_t(m_depth) * m_options.indent);
+    }
+
+    const JsonDumpOptions m_options;
+    unsigned m_depth = 0;
+};
+
+// Appends to a string. The string is grown ahead of the cursor geometrically, and the unused
+// tail is trimmed when the writer goes away.
+class StringWriter final : public JsonWriter {
+public:
+    StringWriter(string &out, const JsonDumpOptions &options) : JsonWriter(options), m_out(out) {
+        m_begin = m_out.data();
+        m_cur = m_end = m_begin + m_out.size();
+    }
+    ~StringWriter() override { m_out.resize(m_cur - m_begin); }
+
+private:
+    void make_room() override {
+        const size_t used = m_cur - m_begin;
+        m_out.resize(std::max(m_out.size() * 2, used + 256));
+        m_begin = m_out.data();
+        m_cur = m_begin + used;
+        m_end = m_begin + m_out.size();
+    }
+
+    string &m_out;
+};
+
+// Passes the output to a sink in chunks of up to buffer_size bytes. Call flush() at the end.
+class SinkWriter final : public JsonWriter {
+public:
+    static constexpr size_t buffer_size = 64 * 1024;
+
+    SinkWriter(const JsonSink &sink, const JsonDumpOptions &options)
+        : JsonWriter(options), m_sink(sink), m_buffer(buffer_size) {
+        m_begin = m_cur = m_buffer.data();
+        m_end = m_begin + m_buffer.size();
+    }
+
+    void flush() {
+        if (m_cur != m_begin)
+            m_sink(m_begin, m_cur - m_begin);
+        m_cur = m_begin;
+    }
+
+private:
+    void make_room() override { flush(); }
+
+    const JsonSink &m_sink;
+    vector<char> m_buffer;
+};
+
+// Writes into a caller's buffer. Output past its end is counted and discarded, so that size()
+// is always the full length; with no buffer at all, this measures the output.
+class BufferWriter final : public JsonWriter {
+public:
+    BufferWriter(char *buffer, size_t capacity, const JsonDumpOptions &options)
+        : JsonWriter(options) {
+        m_begin = m_cur = buffer;
+        m_end = buffer + capacity;
+    }
+
+    size_t size() const { return m_discarded + (m_cur - m_begin); }
+
+private:
+    void make_room() override {
+        m_discarded += m_cur - m_begin;
+        m_begin = m_cur = m_scratch;
+        m_end = m_scratch + sizeof m_scratch;
+    }
+
+    size_t m_discarded = 0;
+    char m_scratch[4096];
+};
+
+// Integers and doubles are formatted straight into the output. Doubles are written in the
+// shortest form that parses back to the same value.
+template <class T>
+static void dump_number(T value, JsonWriter &out) {
+    constexpr size_t max_length = 32;
+    if (out.room() >= max_length) {
+        char *p = out.cursor();
+        out.advance(std::to_chars(p, p + max_length, value).ptr - p);
     } else {
-        out += "null";
-    }
-}
-
-static void dump(int value, string &out) {
-    char buf[32];
-    snprintf(buf, sizeof buf, "%d", value);
-    out += buf;
-}
-
-static void dump(bool value, string &out) {
-    out += value ? "true" : "false";
-}
-
-static void dump(const string &value, string &out) {
-    out += '"';
-    for (size_t i = 0; i < value.length(); i++) {
-        const char ch = value[i];
-        if (ch == '\\') {
-            out += "\\\\";
-        } else if (ch == '"') {
-            out += "\\\"";
-        } else if (ch == '\b') {
-            out += "\\b";
-        } else if (ch == '\f') {
-            out += "\\f";
-        } else if (ch == '\n') {
-            out += "\\n";
-        } else if (ch == '\r') {
-            out += "\\r";
-        } else if (ch == '\t') {
-            out += "\\t";
-        } else if (static_cast<uint8_t>(ch) <= 0x1f) {
-            char buf[8];
-            snprintf(buf, sizeof buf, "\\u%04x", ch);
-            out += buf;
-        } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i+1]) == 0x80
-                   && static_cast<uint8_t>(value[i+2]) == 0xa8) {
-            out += "\\u2028";
-            i += 2;
-        } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i+1]) == 0x80
-                   && static_cast<uint8_t>(value[i+2]) == 0xa9) {
-            out += "\\u2029";
+        char buf[max_length];
+        out.write(buf, std::to_chars(buf, buf + max_length, value).ptr - buf);
+    }
+}
+
+static void dump(double value, JsonWriter &out) {
+    if (std::isfinite(value))
+        dump_number(value, out);
+    else
+        out.literal("null");
+}
+
+static void dump(bool value, JsonWriter &out) {
+    if (value)
+        out.literal("true");
+    else
+        out.literal("false");
+}
+
+/* escapes
+ *
+ * For each byte, the character that follows the backslash in its escape sequence: 'u' for
+ * control characters without a short form, 0 for bytes that are written as they are.
+ */
+static constexpr auto escapes = [] {
+    std::array<char, 256> table {};
+    for (int ch = 0; ch < 0x20; ch++)
+        table[ch] = 'u';
+    table['\b'] = 'b';
+    table['\f'] = 'f';
+    table['\n'] = 'n';
+    table['\r'] = 'r';
+    table['\t'] = 't';
+    table['"'] = '"';
+    table['\\'] = '\\';
+    return table;
+}();
+
+static void dump(const string &value, JsonWriter &out) {
+    static const char hex[] = "0123456789abcdef";
+    const auto scan_escape = kernels().scan_escape;
+    const char *p = value.data();
+    const size_t n = value.size();
+
+    out.put('"');
+    for (size_t i = 0; ; i++) {
+        // Copy the run of characters that need no escaping in one go.
+        const size_t run = scan_escape(p + i, n - i);
+        out.write(p + i, run);
+        i += run;
+        if (i == n)
+            break;
+
+        const uint8_t ch = static_cast<uint8_t>(p[i]);
+        const char escape = escapes[ch];
+        if (escape == 'u') {
+            const char sequence[] = { '\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xf] };
+            out.write(sequence, sizeof sequence);
+        } else if (escape) {
+            const char sequence[] = { '\\', escape };
+            out.write(sequence, sizeof sequence);
+        } else if (i + 2 < n && static_cast<uint8_t>(p[i+1]) == 0x80
+                   && (static_cast<uint8_t>(p[i+2]) & 0xfe) == 0xa8) {
+            // U+2028 and U+2029 are valid JSON, but not valid JavaScript.
+            out.literal(static_cast<uint8_t>(p[i+2]) == 0xa8 ? "\\u2028" : "\\u2029");
             i += 2;
         } else {
-            out += ch;
+            out.put(p[i]);
         }
     }
-    out += '"';
+    out.put('"');
 }
 
-static void dump(const Json::array &values, string &out) {
-    bool first = true;
-    out += "[";
+static void dump(const Json::array &values, JsonWriter &out) {
+    size_t index = 0;
+    out.open('[');
     for (const auto &value : values) {
-        if (!first)
-            out += ", ";
-        value.dump(out);
-        first = false;
+        out.element(index++);
+        out.value(value);
     }
-    out += "]";
+    out.close(']', values.empty());
 }
 
-static void dump(const Json::object &values, string &out) {
-    bool first = true;
-    out += "{";
+static void dump(const Json::object &values, JsonWriter &out) {
+    size_t index = 0;
+    out.open('{');
     for (const auto &kv : values) {
-        if (!first)
-            out += ", ";
+        out.element(index++);
         dump(kv.first, out);
-        out += ": ";
-        kv.second.dump(out);
-        first = false;
+        out.colon();
+        out.value(kv.second);
+    }
+    out.close('}', values.empty());
+}
+
+void JsonWriter::value(const Json &json) {
+    switch (json.m_kind) {
+        case Json::Kind::NUL:    literal("null"); break;
+        case Json::Kind::BOOL:   dump(json.m_value.boolean, *this); break;
+        case Json::Kind::INT:    dump_number(json.m_value.integer, *this); break;
+        case Json::Kind::INT64:  dump_number(json.m_value.int64, *this); break;
+        case Json::Kind::UINT64: dump_number(json.m_value.uint64, *this); break;
+        case Json::Kind::DOUBLE: dump(json.m_value.number, *this); break;
+        case Json::Kind::NODE:   json.m_value.ptr->dump(*this); break;
     }
-    out += "}";
 }
 
-void Json::dump(string &out) const {
-    m_ptr->dump(out);
+void Json::dump(string &out, const JsonDumpOptions &options) const {
+    StringWriter writer(out, options);
+    writer.value(*this);
+}
+
+size_t Json::dump(char *buffer, size_t capacity, const JsonDumpOptions &options) const {
+    BufferWriter writer(buffer, capacity, options);
+    writer.value(*this);
+    return writer.size();
+}
+
+size_t Json::dump_size(const JsonDumpOptions &options) const {
+    return dump(nullptr, 0, options);
+}
+
+void Json::dump(const JsonSink &sink, const JsonDumpOptions &options) const {
+    SinkWriter writer(sink, options);
+    writer.value(*this);
+    writer.flush();
+}
+
+void Json::dump(std::FILE *file, const JsonDumpOptions &options) const {
+    dump([file](const char *data, size_t size) {
+        if (std::fwrite(data, 1, size, file) != size)
+            throw JsonException("failed to write JSON output");
+    }, options);
+}
+
+void Json::dump(std::ostream &stream, const JsonDumpOptions &options) const {
+    dump([&stream](const char *data, size_t size) {
+        stream.write(data, static_cast<std::streamsize>(size));
+    }, options);
+}
+
+void Json::dump_fd(int fd, const JsonDumpOptions &options) const {
+    dump([fd](const char *data, size_t size) {
+        while (size) {
+#ifdef _WIN32
+            const unsigned chunk = static_cast<unsigned>(std::min<size_t>(size, INT_MAX));
+            const int written = _write(fd, data, chunk);
+#else
+            const ssize_t written = ::write(fd, data, size);
+#endif
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw JsonException("failed to write JSON output");
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }, options);
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Reference counting
+ */
+
+void JsonValue::retain() const noexcept {
+#if JSON11_ATOMIC_REFCOUNT
+    m_refcount.fetch_add(1, std::memory_order_relaxed);
+#else
+    ++m_refcount;
+#endif
+}
+
+void JsonValue::release() const noexcept {
+#if JSON11_ATOMIC_REFCOUNT
+    if (m_refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        destroy();
+#else
+    if (--m_refcount == 0)
+        destroy();
+#endif
+}
+
+// Bytes in front of a node allocated from a memory resource, holding a pointer to it
+static constexpr size_t resource_prefix_size =
+    (sizeof(std::pmr::memory_resource *) + alignof(JsonValue) - 1) / alignof(JsonValue)
+    * alignof(JsonValue);
+
+static_assert(sizeof(JsonValue) == sizeof(void *) + 2 * sizeof(uint32_t),
+              "nodes have just a vtable pointer, a refcount and a size");
+
+void JsonValue::destroy() const noexcept {
+    if (!m_size) {
+        delete this;
+        return;
+    }
+    char * const p = reinterpret_cast<char *>(const_cast<JsonValue *>(this)) - resource_prefix_size;
+    std::pmr::memory_resource * const resource = *reinterpret_cast<std::pmr::memory_resource **>(p);
+    const size_t size = resource_prefix_size + m_size;
+    this->~JsonValue();
+    resource->deallocate(p, size, alignof(JsonValue));
 }
 
 /* * * * * * * * * * * * * * * * * * * *
@@ -167,31 +767,7 @@ protected:
     }
 
     T m_value;
-    void dump(string &out) const override { json11::dump(m_value, out); }
-};
-
-class JsonDouble final : public Value<Json::NUMBER, double> {
-    double number_value() const override { return m_value; }
-    int int_value() const override { return static_cast<int>(m_value); }
-    bool equals(const JsonValue * other) const override { return m_value == other->number_value(); }
-    bool less(const JsonValue * other)   const override { return m_value <  other->number_value(); }
-public:
-    explicit JsonDouble(double value) : Value(value) {}
-};
-
-class JsonInt final : public Value<Json::NUMBER, int> {
-    double number_value() const override { return m_value; }
-    int int_value() const override { return m_value; }
-    bool equals(const JsonValue * other) const override { return m_value == other->number_value(); }
-    bool less(const JsonValue * other)   const override { return m_value <  other->number_value(); }
-public:
-    explicit JsonInt(int value) : Value(value) {}
-};
-
-class JsonBoolean final : public Value<Json::BOOL, bool> {
-    bool bool_value() const override { return m_value; }
-public:
-    explicit JsonBoolean(bool value) : Value(value) {}
+    void dump(JsonWriter &out) const override { json11::dump(m_value, out); }
 };
 
 class JsonString final : public Value<Json::STRING, string> {
@@ -214,91 +790,220 @@ public:
 class JsonObject final : public Value<Json::OBJECT, Json::object> {
     const Json::object &object_items() const override { return m_value; }
     Json::object &object_items() override { return m_value; }
-    const Json & operator[](const string &key) const override;
-    Json & operator[](const string &key) override;
+    const Json & operator[](std::string_view key) const override;
+    Json & operator[](std::string_view key) override;
 public:
     explicit JsonObject(const Json::object &value) : Value(value) {}
     explicit JsonObject(Json::object &&value)      : Value(move(value)) {}
 };
 
-class JsonNull final : public Value<Json::NUL, NullStruct> {
-public:
-    JsonNull() : Value({}) {}
-};
+template <class Node, class... Args>
+JsonValue * JsonValue::make(std::pmr::memory_resource *resource, Args &&... args) {
+    static_assert(alignof(Node) <= alignof(JsonValue), "nodes are freed with JsonValue's alignment");
+    if (!resource)
+        return new Node(std::forward<Args>(args)...);
+
+    const size_t size = resource_prefix_size + sizeof(Node);
+    char * const p = static_cast<char *>(resource->allocate(size, alignof(JsonValue)));
+    JsonValue * node;
+    try {
+        node = new (p + resource_prefix_size) Node(std::forward<Args>(args)...);
+    } catch (...) {
+        resource->deallocate(p, size, alignof(JsonValue));
+        throw;
+    }
+    *reinterpret_cast<std::pmr::memory_resource **>(p) = resource;
+    node->m_size = sizeof(Node);
+    return node;
+}
 
 /* * * * * * * * * * * * * * * * * * * *
- * Static globals - static-init-safe
- */
-struct Statics {
-    const std::shared_ptr<JsonValue> null = make_shared<JsonNull>();
-    const std::shared_ptr<JsonValue> t = make_shared<JsonBoolean>(true);
-    const std::shared_ptr<JsonValue> f = make_shared<JsonBoolean>(false);
-    const string empty_string;
-    const vector<Json> empty_vector;
-    const Json::object empty_map;
-    Statics() {}
-};
+ * Constructors
+ */
 
-static const Statics & statics() {
-    static const Statics s {};
-    return s;
+Json::Json() noexcept                  : m_value { .ptr = nullptr },                           m_kind(Kind::NUL)    {}
+Json::Json(std::nullptr_t) noexcept    : m_value { .ptr = nullptr },                           m_kind(Kind::NUL)    {}
+Json::Json(double value)               : m_value { .number = value },                          m_kind(Kind::DOUBLE) {}
+Json::Json(int value)                  : m_value { .integer = value },                         m_kind(Kind::INT)    {}
+Json::Json(int64_t value)              : m_value { .int64 = value },                           m_kind(Kind::INT64)  {}
+Json::Json(uint64_t value)             : m_value { .uint64 = value },                          m_kind(Kind::UINT64) {}
+Json::Json(bool value)                 : m_value { .boolean = value },                         m_kind(Kind::BOOL)   {}
+Json::Json(const string &value)        : m_value { .ptr = new JsonString(value) },             m_kind(Kind::NODE)   {}
+Json::Json(string &&value)             : m_value { .ptr = new JsonString(move(value)) },       m_kind(Kind::NODE)   {}
+Json::Json(const char * value)         : m_value { .ptr = new JsonString(value) },             m_kind(Kind::NODE)   {}
+Json::Json(const Json::array &values)  : m_value { .ptr = new JsonArray(values) },             m_kind(Kind::NODE)   {}
+Json::Json(Json::array &&values)       : m_value { .ptr = new JsonArray(move(values)) },       m_kind(Kind::NODE)   {}
+Json::Json(const Json::object &values) : m_value { .ptr = new JsonObject(values) },            m_kind(Kind::NODE)   {}
+Json::Json(Json::object &&values)      : m_value { .ptr = new JsonObject(move(values)) },      m_kind(Kind::NODE)   {}
+
+Json::Json(string &&value, std::pmr::memory_resource *resource)
+    : m_value { .ptr = JsonValue::make<JsonString>(resource, move(value)) }, m_kind(Kind::NODE) {}
+Json::Json(Json::array &&values, std::pmr::memory_resource *resource)
+    : m_value { .ptr = JsonValue::make<JsonArray>(resource, move(values)) }, m_kind(Kind::NODE) {}
+Json::Json(Json::object &&values, std::pmr::memory_resource *resource)
+    : m_value { .ptr = JsonValue::make<JsonObject>(resource, move(values)) }, m_kind(Kind::NODE) {}
+
+Json::Json(const Json &other) noexcept : m_value(other.m_value), m_kind(other.m_kind) {
+    if (m_kind == Kind::NODE)
+        m_value.ptr->retain();
 }
 
-static const Json & static_null() {
-    // This has to be separate, not in Statics, because Json() accesses statics().null.
-    static const Json json_null;
-    return json_null;
+// A moved-from Json is left as null.
+Json::Json(Json &&other) noexcept : m_value(other.m_value), m_kind(other.m_kind) {
+    other.m_kind = Kind::NUL;
 }
 
-/* * * * * * * * * * * * * * * * * * * *
- * Constructors
- */
+Json::~Json() {
+    if (m_kind == Kind::NODE)
+        m_value.ptr->release();
+}
+
+Json & Json::operator= (const Json &other) noexcept {
+    if (other.m_kind == Kind::NODE)
+        other.m_value.ptr->retain();
+    if (m_kind == Kind::NODE)
+        m_value.ptr->release();
+    m_value = other.m_value;
+    m_kind = other.m_kind;
+    return *this;
+}
 
-Json::Json() noexcept                  : m_ptr(statics().null) {}
-Json::Json(std::nullptr_t) noexcept    : m_ptr(statics().null) {}
-Json::Json(double value)               : m_ptr(make_shared<JsonDouble>(value)) {}
-Json::Json(int value)                  : m_ptr(make_shared<JsonInt>(value)) {}
-Json::Json(bool value)                 : m_ptr(value ? statics().t : statics().f) {}
-Json::Json(const string &value)        : m_ptr(make_shared<JsonString>(value)) {}
-Json::Json(string &&value)             : m_ptr(make_shared<JsonString>(move(value))) {}
-Json::Json(const char * value)         : m_ptr(make_shared<JsonString>(value)) {}
-Json::Json(const Json::array &values)  : m_ptr(make_shared<JsonArray>(values)) {}
-Json::Json(Json::array &&values)       : m_ptr(make_shared<JsonArray>(move(values))) {}
-Json::Json(const Json::object &values) : m_ptr(make_shared<JsonObject>(values)) {}
-Json::Json(Json::object &&values)      : m_ptr(make_shared<JsonObject>(move(values))) {}
+Json & Json::operator= (Json &&other) noexcept {
+    if (this == &other)
+        return *this;
+    if (m_kind == Kind::NODE)
+        m_value.ptr->release();
+    m_value = other.m_value;
+    m_kind = other.m_kind;
+    other.m_kind = Kind::NUL;
+    return *this;
+}
 
 /* * * * * * * * * * * * * * * * * * * *
  * Accessors
  */
 
-Json::Type Json::type()                           const { return m_ptr->type();         }
-double Json::number_value()                       const { return m_ptr->number_value(); }
-int Json::int_value()                             const { return m_ptr->int_value();    }
-bool Json::bool_value()                           const { return m_ptr->bool_value();   }
-const string & Json::string_value()               const { return m_ptr->string_value(); }
-const Json::array & Json::array_items()           const { return m_ptr->array_items();  }
-Json::array & Json::array_items()                       { return m_ptr->array_items();  }
-const Json::object & Json::object_items()         const { return m_ptr->object_items(); }
-Json::object & Json::object_items()                     { return m_ptr->object_items(); }
-const Json & Json::operator[] (size_t i)          const { return (*m_ptr)[i];           }
-Json & Json::operator[] (size_t i)                      { return (*m_ptr)[i];           }
-const Json & Json::operator[] (const string &key) const { return (*m_ptr)[key];         }
-Json & Json::operator[] (const string &key)             { return (*m_ptr)[key];         }
-
-double                    JsonValue::number_value()              const { throw JsonException("not a number"); }
-int                       JsonValue::int_value()                 const { throw JsonException("not a number"); }
-bool                      JsonValue::bool_value()                const { throw JsonException("not a bool"); }
-const string &            JsonValue::string_value()              const { throw JsonException("not a string"); }
-const Json::array &       JsonValue::array_items()               const { throw JsonException("not an array"); }
-Json::array &             JsonValue::array_items()                     { throw JsonException("not an array"); }
-const Json::object &      JsonValue::object_items()              const { throw JsonException("not an object"); }
-Json::object &            JsonValue::object_items()                    { throw JsonException("not an object"); }
-const Json &              JsonValue::operator[] (size_t)         const { throw JsonException("not an array"); }
-Json &                    JsonValue::operator[] (size_t)               { throw JsonException("not an array"); }
-const Json &              JsonValue::operator[] (const string &) const { throw JsonException("not an object"); }
-Json &                    JsonValue::operator[] (const string &)       { throw JsonException("not an object"); }
-
-const Json& JsonObject::operator[] (const string &key) const {
+Json::Type Json::type() const {
+    switch (m_kind) {
+        case Kind::NUL:    return NUL;
+        case Kind::BOOL:   return BOOL;
+        case Kind::INT:    return NUMBER;
+        case Kind::INT64:  return NUMBER;
+        case Kind::UINT64: return NUMBER;
+        case Kind::DOUBLE: return NUMBER;
+        case Kind::NODE:   break;
+    }
+    return m_value.ptr->type();
+}
+
+double Json::number_value() const {
+    if (m_kind == Kind::DOUBLE) return m_value.number;
+    if (m_kind == Kind::INT)    return m_value.integer;
+    if (m_kind == Kind::INT64)  return static_cast<double>(m_value.int64);
+    if (m_kind == Kind::UINT64) return static_cast<double>(m_value.uint64);
+    throw JsonException("not a number");
+}
+
+/* saturate<T>(value)
+ *
+ * Convert a number to the integer type T, clamping it to T's range. A double outside that
+ * range cannot be converted with static_cast, so it is clamped first; NaN converts to 0.
+ */
+template <class T, class U>
+static T saturate(U value) {
+    if constexpr (std::is_floating_point_v<U>) {
+        if (std::isnan(value))
+            return 0;
+        if (value <= static_cast<U>(std::numeric_limits<T>::min()))
+            return std::numeric_limits<T>::min();
+        if (value >= static_cast<U>(std::numeric_limits<T>::max()))
+            return std::numeric_limits<T>::max();
+        return static_cast<T>(value);
+    } else {
+        if (std::in_range<T>(value))
+            return static_cast<T>(value);
+        return value < 0 ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+    }
+}
+
+int Json::int_value() const {
+    if (m_kind == Kind::INT)    return m_value.integer;
+    if (m_kind == Kind::DOUBLE) return saturate<int>(m_value.number);
+    if (m_kind == Kind::INT64)  return saturate<int>(m_value.int64);
+    if (m_kind == Kind::UINT64) return saturate<int>(m_value.uint64);
+    throw JsonException("not a number");
+}
+
+int64_t Json::int64_value() const {
+    if (m_kind == Kind::INT64)  return m_value.int64;
+    if (m_kind == Kind::INT)    return m_value.integer;
+    if (m_kind == Kind::UINT64) return saturate<int64_t>(m_value.uint64);
+    if (m_kind == Kind::DOUBLE) return saturate<int64_t>(m_value.number);
+    throw JsonException("not a number");
+}
+
+uint64_t Json::uint64_value() const {
+    if (m_kind == Kind::UINT64) return m_value.uint64;
+    if (m_kind == Kind::INT)    return saturate<uint64_t>(m_value.integer);
+    if (m_kind == Kind::INT64)  return saturate<uint64_t>(m_value.int64);
+    if (m_kind == Kind::DOUBLE) return saturate<uint64_t>(m_value.number);
+    throw JsonException("not a number");
+}
+
+bool Json::bool_value() const {
+    if (m_kind == Kind::BOOL) return m_value.boolean;
+    throw JsonException("not a bool");
+}
+
+// Inline values have no node to defer to, so the throwing accessors are repeated here.
+const string & Json::string_value() const {
+    if (m_kind != Kind::NODE) throw JsonException("not a string");
+    return m_value.ptr->string_value();
+}
+const Json::array & Json::array_items() const {
+    if (m_kind != Kind::NODE) throw JsonException("not an array");
+    return m_value.ptr->array_items();
+}
+Json::array & Json::array_items() {
+    if (m_kind != Kind::NODE) throw JsonException("not an array");
+    return m_value.ptr->array_items();
+}
+const Json::object & Json::object_items() const {
+    if (m_kind != Kind::NODE) throw JsonException("not an object");
+    return m_value.ptr->object_items();
+}
+Json::object & Json::object_items() {
+    if (m_kind != Kind::NODE) throw JsonException("not an object");
+    return m_value.ptr->object_items();
+}
+const Json & Json::operator[] (size_t i) const {
+    if (m_kind != Kind::NODE) throw JsonException("not an array");
+    return (*m_value.ptr)[i];
+}
+Json & Json::operator[] (size_t i) {
+    if (m_kind != Kind::NODE) throw JsonException("not an array");
+    return (*m_value.ptr)[i];
+}
+const Json & Json::operator[] (std::string_view key) const {
+    if (m_kind != Kind::NODE) throw JsonException("not an object");
+    return (*m_value.ptr)[key];
+}
+Json & Json::operator[] (std::string_view key) {
+    if (m_kind != Kind::NODE) throw JsonException("not an object");
+    return (*m_value.ptr)[key];
+}
+
+const string &            JsonValue::string_value()                const { throw JsonException("not a string"); }
+const Json::array &       JsonValue::array_items()                 const { throw JsonException("not an array"); }
+Json::array &             JsonValue::array_items()                       { throw JsonException("not an array"); }
+const Json::object &      JsonValue::object_items()                const { throw JsonException("not an object"); }
+Json::object &            JsonValue::object_items()                      { throw JsonException("not an object"); }
+const Json &              JsonValue::operator[] (size_t)           const { throw JsonException("not an array"); }
+Json &                    JsonValue::operator[] (size_t)                 { throw JsonException("not an array"); }
+const Json &              JsonValue::operator[] (std::string_view) const { throw JsonException("not an object"); }
+Json &                    JsonValue::operator[] (std::string_view)       { throw JsonException("not an object"); }
+
+const Json& JsonObject::operator[] (std::string_view key) const {
     auto iter = m_value.find(key);
     if (iter == m_value.end()) {
         throw JsonException("invalid key");
@@ -306,7 +1011,7 @@ const Json& JsonObject::operator[] (const string &key) const {
         return iter->second;
     }
 }
-Json& JsonObject::operator[] (const string &key) {
+Json& JsonObject::operator[] (std::string_view key) {
     return m_value[key];
 }
 const Json & JsonArray::operator[] (size_t i) const {
@@ -322,22 +1027,54 @@ Json& JsonArray::operator[] (size_t i) {
  * Comparison
  */
 
+int Json::compare_numbers(const Json &other) const {
+    const auto is_integer = [](Kind kind) {
+        return kind == Kind::INT || kind == Kind::INT64 || kind == Kind::UINT64;
+    };
+    if (!is_integer(m_kind) || !is_integer(other.m_kind)) {
+        const double a = number_value(), b = other.number_value();
+        return a < b ? -1 : b < a ? 1 : 0;
+    }
+    // Only a UINT64 can hold values above INT64_MAX; below that, both fit in an int64_t.
+    const bool a_large = m_kind == Kind::UINT64 && m_value.uint64 > INT64_MAX;
+    const bool b_large = other.m_kind == Kind::UINT64 && other.m_value.uint64 > INT64_MAX;
+    if (a_large || b_large) {
+        if (a_large != b_large)
+            return a_large ? 1 : -1;
+        return m_value.uint64 < other.m_value.uint64 ? -1 : other.m_value.uint64 < m_value.uint64;
+    }
+    const int64_t a = int64_value(), b = other.int64_value();
+    return a < b ? -1 : b < a;
+}
+
 bool Json::operator== (const Json &other) const {
-    if (m_ptr == other.m_ptr)
+    if (m_kind == Kind::NODE && other.m_kind == Kind::NODE && m_value.ptr == other.m_value.ptr)
         return true;
-    if (m_ptr->type() != other.m_ptr->type())
+    const Type t = type();
+    if (t != other.type())
         return false;
 
-    return m_ptr->equals(other.m_ptr.get());
+    switch (t) {
+        case NUL:    return true;
+        case BOOL:   return m_value.boolean == other.m_value.boolean;
+        case NUMBER: return compare_numbers(other) == 0;
+        default:     return m_value.ptr->equals(other.m_value.ptr);
+    }
 }
 
 bool Json::operator< (const Json &other) const {
-    if (m_ptr == other.m_ptr)
+    if (m_kind == Kind::NODE && other.m_kind == Kind::NODE && m_value.ptr == other.m_value.ptr)
         return false;
-    if (m_ptr->type() != other.m_ptr->type())
-        return m_ptr->type() < other.m_ptr->type();
-
-    return m_ptr->less(other.m_ptr.get());
+    const Type t = type();
+    if (t != other.type())
+        return t < other.type();
+
+    switch (t) {
+        case NUL:    return false;
+        case BOOL:   return m_value.boolean < other.m_value.boolean;
+        case NUMBER: return compare_numbers(other) < 0;
+        default:     return m_value.ptr->less(other.m_value.ptr);
+    }
 }
 
 /* * * * * * * * * * * * * * * * * * * *
@@ -363,19 +1100,73 @@ static inline bool in_range(long x, long lower, long upper) {
 }
 
 namespace {
+/* NestingStack
+ *
+ * The open arrays and objects of a parse, innermost last, as one bit each: set for an
+ * object. Enough levels for the default depth limit are kept inline, so that only documents
+ * nested deeper than that allocate for it.
+ */
+class NestingStack final {
+public:
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+
+    bool top() const {
+        const size_t k = m_size - 1;
+        return (word(k) >> (k % 64)) & 1;
+    }
+
+    void push(bool object) {
+        const size_t k = m_size++;
+        // Levels are entered again and again; only the first entry to a word adds it.
+        if (k / 64 >= inline_words && k / 64 - inline_words == m_overflow.size())
+            m_overflow.push_back(0);
+        const uint64_t bit = uint64_t(1) << (k % 64);
+        word(k) = object ? word(k) | bit : word(k) & ~bit;
+    }
+
+    void pop() { m_size--; }
+
+private:
+    static const size_t inline_words = 4;
+
+    uint64_t &word(size_t k) {
+        return k / 64 < inline_words ? m_inline[k / 64] : m_overflow[k / 64 - inline_words];
+    }
+    uint64_t word(size_t k) const {
+        return k / 64 < inline_words ? m_inline[k / 64] : m_overflow[k / 64 - inline_words];
+    }
+
+    std::array<uint64_t, inline_words> m_inline {};
+    // From the default memory resource, like the rest of a parse's working storage.
+    std::pmr::vector<uint64_t> m_overflow;
+    size_t m_size = 0;
+};
+
 /* JsonParser
  *
- * Object that tracks all state of an in-progress parse.
+ * Object that tracks all state of an in-progress parse. The parser checks the grammar and
+ * passes what it reads to a handler as events; see JsonHandler for the interface. Json::parse
+ * uses JsonBuilder as the handler, and Json::parse with a JsonHandler uses that directly.
  */
+template <class Handler>
 struct JsonParser final {
 
     /* State
      */
-    const string &str;
+    const std::string_view str;
     size_t i;
     string &err;
     bool failed;
-    const JsonParse strategy;
+    const JsonParseOptions options;
+    Handler &handler;
+    // Unescaped contents of the last string that had escapes.
+    string scratch;
+
+    // Handlers that only check the input declare a static member check_only. Strings are
+    // then checked without being unescaped and numbers without being converted, so nothing
+    // is allocated, and the handler is passed empty strings and null numbers.
+    static constexpr bool check_only = requires { Handler::check_only; };
 
     /* fail(msg, err_ret = Json())
      *
@@ -393,13 +1184,27 @@ struct JsonParser final {
         return err_ret;
     }
 
+    /* at(pos)
+     *
+     * Return the character at pos, or 0 past the end of the input. The input is not
+     * necessarily NUL-terminated, so lookahead that may run off the end goes through here.
+     */
+    char at(size_t pos) const {
+        return pos < str.size() ? str[pos] : static_cast<char>(0);
+    }
+
     /* consume_whitespace()
      *
-     * Advance until the current character is non-whitespace.
+     * Advance until the current character is non-whitespace. Minified input and the single
+     * spaces after ',' and ':' are handled here; longer runs such as indentation go to the
+     * vectorized skipper.
      */
     void consume_whitespace() {
-        while (str[i] == ' ' || str[i] == '\r' || str[i] == '\n' || str[i] == '\t')
+        if (i < str.size() && is_whitespace(str[i])) {
             i++;
+            if (i < str.size() && is_whitespace(str[i]))
+                i += kernels().skip_whitespace(str.data() + i, str.size() - i);
+        }
     }
 
     /* consume_comment()
@@ -408,7 +1213,7 @@ struct JsonParser final {
      */
     bool consume_comment() {
       bool comment_found = false;
-      if (str[i] == '/') {
+      if (at(i) == '/') {
         i++;
         if (i == str.size())
           return fail("unexpected end of input after start of comment", false);
@@ -446,7 +1251,7 @@ struct JsonParser final {
      */
     void consume_garbage() {
       consume_whitespace();
-      if(strategy == JsonParse::COMMENTS) {
+      if(options.strategy == JsonParse::COMMENTS) {
         bool comment_found = false;
         do {
           comment_found = consume_comment();
@@ -471,6 +1276,20 @@ struct JsonParser final {
         return str[i++];
     }
 
+    /* emit(ok)
+     *
+     * Check the result of a handler event. If the handler asked to stop, flag an error.
+     */
+    bool emit(bool ok) {
+        if (!ok) {
+            if constexpr (requires { handler.error; })
+                fail(move(handler.error));
+            else
+                fail("parse stopped by handler");
+        }
+        return ok;
+    }
+
     /* encode_utf8(pt, out)
      *
      * Encode pt as UTF-8 and add it to out.
@@ -498,14 +1317,36 @@ struct JsonParser final {
 
     /* parse_string()
      *
-     * Parse a string, starting at the current position.
+     * Parse a string, starting at the current position. The result points into the input, or
+     * into scratch if the string had escapes, and is valid until the next call.
      */
-    string parse_string() {
-        string out;
+    std::string_view parse_string() {
+        // The usual case: no escapes, so the contents can be used straight from the input
+        const size_t start = i;
+        const size_t run = kernels().scan_string(str.data() + i, str.size() - i);
+        if (start + run < str.size() && str[start + run] == '"') {
+            i = start + run + 1;
+            return str.substr(start, run);
+        }
+        if constexpr (check_only)
+            return check_string();
+
+        string &out = scratch;
+        out.clear();
         long last_escaped_codepoint = -1;
+        const Kernels &k = kernels();
         while (true) {
+            // The usual case: a run of non-escaped characters, copied in one go
+            const size_t run = k.scan_string(str.data() + i, str.size() - i);
+            if (run) {
+                encode_utf8(last_escaped_codepoint, out);
+                last_escaped_codepoint = -1;
+                out.append(str.data() + i, run);
+                i += run;
+            }
+
             if (i == str.size())
-                return fail("unexpected end of input in string", "");
+                return fail("unexpected end of input in string", std::string_view());
 
             char ch = str[i++];
 
@@ -515,35 +1356,26 @@ struct JsonParser final {
             }
 
             if (in_range(ch, 0, 0x1f))
-                return fail("unescaped " + esc(ch) + " in string", "");
-
-            // The usual case: non-escaped characters
-            if (ch != '\\') {
-                encode_utf8(last_escaped_codepoint, out);
-                last_escaped_codepoint = -1;
-                out += ch;
-                continue;
-            }
+                return fail("unescaped " + esc(ch) + " in string", std::string_view());
 
             // Handle escapes
             if (i == str.size())
-                return fail("unexpected end of input in string", "");
+                return fail("unexpected end of input in string", std::string_view());
 
             ch = str[i++];
 
             if (ch == 'u') {
                 // Extract 4-byte escape sequence
-                string esc = str.substr(i, 4);
-                // Explicitly check length of the substring. The following loop
-                // relies on std::string returning the terminating NUL when
-                // accessing str[length]. Checking here reduces brittleness.
+                string esc(str.substr(i, 4));
+                // Explicitly check length of the substring, since the input may end
+                // in the middle of the escape.
                 if (esc.length() < 4) {
-                    return fail("bad \\u escape: " + esc, "");
+                    return fail("bad \\u escape: " + esc, std::string_view());
                 }
                 for (size_t j = 0; j < 4; j++) {
                     if (!in_range(esc[j], 'a', 'f') && !in_range(esc[j], 'A', 'F')
                             && !in_range(esc[j], '0', '9'))
-                        return fail("bad \\u escape: " + esc, "");
+                        return fail("bad \\u escape: " + esc, std::string_view());
                 }
 
                 long codepoint = strtol(esc.data(), nullptr, 16);
@@ -584,192 +1416,767 @@ struct JsonParser final {
             } else if (ch == '"' || ch == '\\' || ch == '/') {
                 out += ch;
             } else {
-                return fail("invalid escape character " + esc(ch), "");
+                return fail("invalid escape character " + esc(ch), std::string_view());
+            }
+        }
+    }
+
+    /* check_string()
+     *
+     * Check the rest of a string that has escapes, with the same errors as parse_string.
+     */
+    std::string_view check_string() {
+        const Kernels &k = kernels();
+        while (true) {
+            i += k.scan_string(str.data() + i, str.size() - i);
+            if (i == str.size())
+                return fail("unexpected end of input in string", std::string_view());
+
+            char ch = str[i++];
+            if (ch == '"')
+                return std::string_view();
+            if (in_range(ch, 0, 0x1f))
+                return fail("unescaped " + esc(ch) + " in string", std::string_view());
+            if (i == str.size())
+                return fail("unexpected end of input in string", std::string_view());
+
+            ch = str[i++];
+            if (ch == 'u') {
+                const std::string_view digits = str.substr(i, 4);
+                if (digits.size() < 4 || !std::all_of(digits.begin(), digits.end(), [](char c) {
+                        return in_range(c, 'a', 'f') || in_range(c, 'A', 'F') || in_range(c, '0', '9');
+                    }))
+                    return fail("bad \\u escape: " + string(digits), std::string_view());
+                i += 4;
+            } else if (ch != 'b' && ch != 'f' && ch != 'n' && ch != 'r' && ch != 't' && ch != '"'
+                       && ch != '\\' && ch != '/') {
+                return fail("invalid escape character " + esc(ch), std::string_view());
             }
         }
     }
 
     /* parse_number()
      *
-     * Parse a double.
+     * Parse a number. Integers are accumulated while they are scanned and kept exactly if
+     * they fit in 64 bits; anything else is converted with std::from_chars, which unlike
+     * strtod ignores the current locale.
      */
     Json parse_number() {
         size_t start_pos = i;
+        const bool negative = at(i) == '-';
 
-        if (str[i] == '-')
+        if (negative)
             i++;
 
         // Integer part
-        if (str[i] == '0') {
+        const size_t digits_pos = i;
+        uint64_t magnitude = 0;
+        if (at(i) == '0') {
             i++;
-            if (in_range(str[i], '0', '9'))
+            if (in_range(at(i), '0', '9'))
                 return fail("leading 0s not permitted in numbers");
-        } else if (in_range(str[i], '1', '9')) {
-            i++;
-            while (in_range(str[i], '0', '9'))
-                i++;
+        } else if (in_range(at(i), '1', '9')) {
+            // Wraps past 19 digits; such numbers are checked again below.
+            while (in_range(at(i), '0', '9'))
+                magnitude = magnitude * 10 + static_cast<unsigned>(str[i++] - '0');
         } else {
-            return fail("invalid " + esc(str[i]) + " in number");
+            return fail("invalid " + esc(at(i)) + " in number");
         }
 
-        if (str[i] != '.' && str[i] != 'e' && str[i] != 'E'
-                && (i - start_pos) <= static_cast<size_t>(std::numeric_limits<int>::digits10)) {
-            return std::atoi(str.c_str() + start_pos);
+        if (at(i) != '.' && at(i) != 'e' && at(i) != 'E') {
+            const size_t digits = i - digits_pos;
+            bool exact = digits <= std::numeric_limits<uint64_t>::digits10;
+            if (!exact && digits == std::numeric_limits<uint64_t>::digits10 + 1) {
+                const auto result = std::from_chars(str.data() + digits_pos, str.data() + i,
+                                                    magnitude);
+                exact = result.ec == std::errc();
+            }
+            if (exact && !negative) {
+                if (magnitude <= static_cast<uint64_t>(std::numeric_limits<int>::max()))
+                    return static_cast<int>(magnitude);
+                if (magnitude <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+                    return static_cast<int64_t>(magnitude);
+                return magnitude;
+            }
+            if (exact && magnitude <= uint64_t(1) << 63) {
+                const int64_t value = static_cast<int64_t>(0 - magnitude);
+                if (value >= std::numeric_limits<int>::min())
+                    return static_cast<int>(value);
+                return value;
+            }
         }
 
         // Decimal part
-        if (str[i] == '.') {
+        if (at(i) == '.') {
             i++;
-            if (!in_range(str[i], '0', '9'))
+            if (!in_range(at(i), '0', '9'))
                 return fail("at least one digit required in fractional part");
 
-            while (in_range(str[i], '0', '9'))
+            while (in_range(at(i), '0', '9'))
                 i++;
         }
 
         // Exponent part
-        if (str[i] == 'e' || str[i] == 'E') {
+        if (at(i) == 'e' || at(i) == 'E') {
             i++;
 
-            if (str[i] == '+' || str[i] == '-')
+            if (at(i) == '+' || at(i) == '-')
                 i++;
 
-            if (!in_range(str[i], '0', '9'))
+            if (!in_range(at(i), '0', '9'))
                 return fail("at least one digit required in exponent");
 
-            while (in_range(str[i], '0', '9'))
+            while (in_range(at(i), '0', '9'))
                 i++;
         }
 
-        return std::strtod(str.c_str() + start_pos, nullptr);
+        if constexpr (check_only)
+            return Json();
+
+        double value;
+        const auto result = std::from_chars(str.data() + start_pos, str.data() + i, value);
+        if (result.ec == std::errc::result_out_of_range) {
+            // Overflow to infinity and underflow to zero, as strtod does.
+            return std::strtod(string(str.substr(start_pos, i - start_pos)).c_str(), nullptr);
+        }
+        return value;
     }
 
-    /* expect(str, res)
+    /* expect(str)
      *
      * Expect that 'str' starts at the character that was just read. If it does, advance
-     * the input and return res. If not, flag an error.
+     * the input and return true. If not, flag an error.
      */
-    Json expect(const string &expected, Json res) {
+    bool expect(const string &expected) {
         assert(i != 0);
         i--;
         if (str.compare(i, expected.length(), expected) == 0) {
             i += expected.length();
-            return res;
+            return true;
         } else {
-            return fail("parse error: expected " + expected + ", got " + str.substr(i, expected.length()));
+            return fail("parse error: expected " + expected + ", got " + string(str.substr(i, expected.length())), false);
         }
     }
 
+    /* parse_key(ch)
+     *
+     * Parse an object member's key, whose opening quote should be ch, and the ':' after it.
+     */
+    bool parse_key(char ch) {
+        if (ch != '"')
+            return fail("expected '\"' in object, got " + esc(ch), false);
+
+        const std::string_view key = parse_string();
+        if (failed || !emit(handler.on_key(key)))
+            return false;
+
+        ch = get_next_token();
+        if (ch != ':')
+            return fail("expected ':' in object, got " + esc(ch), false);
+        return true;
+    }
+
     /* parse_json()
      *
-     * Parse a JSON object.
+     * Parse a JSON value, passing it to the handler. The open arrays and objects are kept on
+     * an explicit stack rather than by recursion, so that options.max_depth can be raised
+     * without running out of call stack.
      */
-    Json parse_json(int depth) {
-        if (depth > max_depth) {
-            return fail("exceeded maximum nesting depth");
-        }
+    bool parse_json() {
+        NestingStack open;
+        char ch;
+        while (1) {
+            if (open.size() > options.max_depth)
+                return fail("exceeded maximum nesting depth", false);
 
-        char ch = get_next_token();
-        if (failed)
-            return Json();
+            ch = get_next_token();
+            if (failed)
+                return false;
 
-        if (ch == '-' || (ch >= '0' && ch <= '9')) {
-            i--;
-            return parse_number();
-        }
+            if (ch == '-' || (ch >= '0' && ch <= '9')) {
+                i--;
+                const Json number = parse_number();
+                if (failed || !emit(handler.on_number(number)))
+                    return false;
+            } else if (ch == 't') {
+                if (!expect("true") || !emit(handler.on_bool(true)))
+                    return false;
+            } else if (ch == 'f') {
+                if (!expect("false") || !emit(handler.on_bool(false)))
+                    return false;
+            } else if (ch == 'n') {
+                if (!expect("null") || !emit(handler.on_null()))
+                    return false;
+            } else if (ch == '"') {
+                const std::string_view value = parse_string();
+                if (failed || !emit(handler.on_string(value)))
+                    return false;
+            } else if (ch == '{') {
+                if (!emit(handler.start_object()))
+                    return false;
+                ch = get_next_token();
+                if (ch != '}') {
+                    // Go on to the first member's value
+                    if (!parse_key(ch))
+                        return false;
+                    open.push(true);
+                    continue;
+                }
+                if (!emit(handler.end_object()))
+                    return false;
+            } else if (ch == '[') {
+                if (!emit(handler.start_array()))
+                    return false;
+                ch = get_next_token();
+                if (failed)
+                    return false;
+                if (ch != ']') {
+                    // Go on to the first element, starting from its first character
+                    i--;
+                    open.push(false);
+                    continue;
+                }
+                if (!emit(handler.end_array()))
+                    return false;
+            } else {
+                return fail("expected value, got " + esc(ch), false);
+            }
 
-        if (ch == 't')
-            return expect("true", true);
+            // A value is complete. Close the arrays and objects it completes, then go on to
+            // the next element or member's value, if there is one.
+            while (1) {
+                if (open.empty())
+                    return true;
 
-        if (ch == 'f')
-            return expect("false", false);
+                ch = get_next_token();
+                if (open.top()) {
+                    if (ch == '}') {
+                        open.pop();
+                        if (!emit(handler.end_object()))
+                            return false;
+                        continue;
+                    }
+                    if (ch != ',')
+                        return fail("expected ',' in object, got " + esc(ch), false);
+                    if (!parse_key(get_next_token()))
+                        return false;
+                } else {
+                    if (ch == ']') {
+                        open.pop();
+                        if (!emit(handler.end_array()))
+                            return false;
+                        continue;
+                    }
+                    if (ch != ',')
+                        return fail("expected ',' in list, got " + esc(ch), false);
+                }
+                break;
+            }
+        }
+    }
+};
 
-        if (ch == 'n')
-            return expect("null", Json());
+/* JsonBuilder
+ *
+ * Handler that builds Json values, allocating their nodes from 'resource' (null meaning the
+ * global heap). Arrays and objects under construction are kept on stacks; each finished
+ * value goes into the innermost one, or becomes the root.
+ */
+struct JsonBuilder final {
+    std::pmr::memory_resource * const resource;
+    const JsonParseOptions options;
+    Json root;
+    // Message for the parse error when an event is rejected.
+    string error;
+
+    std::pmr::vector<Json::array> arrays;
+    std::pmr::vector<std::pmr::vector<Json::object::value_type>> objects;
+    // For each open container, innermost last: whether it is an object.
+    std::pmr::vector<bool> in_object;
+    // Reused space for resolving duplicate keys in large objects.
+    vector<uint32_t> key_scratch;
+
+    JsonBuilder(std::pmr::memory_resource *resource, const JsonParseOptions &options)
+        : resource(resource), options(options), arrays(storage()), objects(storage()),
+          in_object(storage()) {}
+
+    /* storage()
+     *
+     * Resource for array and object storage. Nodes are allocated from 'resource' directly,
+     * where null means the global heap; containers need a real resource.
+     */
+    std::pmr::memory_resource * storage() const {
+        return resource ? resource : std::pmr::get_default_resource();
+    }
 
-        if (ch == '"')
-            return parse_string();
+    bool value(Json &&value) {
+        if (in_object.empty())
+            root = move(value);
+        else if (in_object.back())
+            objects.back().back().second = move(value);
+        else
+            arrays.back().push_back(move(value));
+        return true;
+    }
 
-        if (ch == '{') {
-            map<string, Json> data;
-            ch = get_next_token();
-            if (ch == '}')
-                return data;
+    bool on_null() { return value(Json()); }
+    bool on_bool(bool b) { return value(b); }
+    bool on_number(const Json &number) { return value(Json(number)); }
+    bool on_string(std::string_view s) { return value(Json(string(s), resource)); }
 
-            while (1) {
-                if (ch != '"')
-                    return fail("expected '\"' in object, got " + esc(ch));
+    bool on_key(std::string_view key) {
+        objects.back().emplace_back(string(key), Json());
+        return true;
+    }
 
-                string key = parse_string();
-                if (failed)
-                    return Json();
+    bool start_array() {
+        arrays.emplace_back();
+        in_object.push_back(false);
+        return true;
+    }
 
-                ch = get_next_token();
-                if (ch != ':')
-                    return fail("expected ':' in object, got " + esc(ch));
+    bool end_array() {
+        Json result(move(arrays.back()), resource);
+        arrays.pop_back();
+        in_object.pop_back();
+        return value(move(result));
+    }
 
-                data[std::move(key)] = parse_json(depth + 1);
-                if (failed)
-                    return Json();
+    bool start_object() {
+        objects.emplace_back();
+        in_object.push_back(true);
+        return true;
+    }
 
-                ch = get_next_token();
-                if (ch == '}')
-                    break;
-                if (ch != ',')
-                    return fail("expected ',' in object, got " + esc(ch));
+    bool end_object() {
+        if (!resolve_duplicate_keys(objects.back()))
+            return false;
+        Json result(Json::object(move(objects.back())), resource);
+        objects.pop_back();
+        in_object.pop_back();
+        return value(move(result));
+    }
 
-                ch = get_next_token();
+    /* resolve_duplicate_keys(members)
+     *
+     * Apply the duplicate key policy to the members of a just-parsed object, in place. If
+     * duplicates are rejected, set the error and return false.
+     */
+    bool resolve_duplicate_keys(std::pmr::vector<Json::object::value_type> &members) {
+        static const size_t small_object = 16;
+        const size_t n = members.size();
+        if (n < 2)
+            return true;
+
+        // first[k] is the index of the first member sharing member k's key, and slot[k] is
+        // where a kept member k moves to. Small objects compare every pair, and only set these
+        // up, on the stack, once a duplicate turns up. Larger ones sort member indices by key
+        // in key_scratch, which is reused from object to object, so equal keys are adjacent.
+        uint32_t small[2 * small_object];
+        uint32_t *first, *slot;
+        if (n <= small_object) {
+            const auto earlier = [&](size_t k) {
+                size_t j = 0;
+                while (j < k && members[j].first != members[k].first)
+                    j++;
+                return static_cast<uint32_t>(j);
+            };
+            size_t duplicate = 1;
+            while (duplicate < n && earlier(duplicate) == duplicate)
+                duplicate++;
+            if (duplicate == n)
+                return true;
+
+            first = small;
+            slot = small + small_object;
+            for (size_t k = 0; k < n; k++)
+                first[k] = k < duplicate ? static_cast<uint32_t>(k) : earlier(k);
+        } else {
+            key_scratch.resize(2 * n);
+            uint32_t * const order = key_scratch.data();
+            first = order + n;
+            slot = order; // once order is no longer needed
+            for (size_t k = 0; k < n; k++)
+                order[k] = static_cast<uint32_t>(k);
+            std::stable_sort(order, order + n, [&](uint32_t a, uint32_t b) {
+                return members[a].first < members[b].first;
+            });
+            bool found = false;
+            first[order[0]] = order[0];
+            for (size_t k = 1; k < n; k++) {
+                if (members[order[k]].first == members[order[k - 1]].first) {
+                    first[order[k]] = first[order[k - 1]];
+                    found = true;
+                } else {
+                    first[order[k]] = order[k];
+                }
             }
-            return data;
+            if (!found)
+                return true;
         }
 
-        if (ch == '[') {
-            vector<Json> data;
-            ch = get_next_token();
-            if (ch == ']')
-                return data;
+        // Compact the kept members in order, remembering where each one moved to.
+        size_t out = 0;
+        for (size_t k = 0; k < n; k++) {
+            if (first[k] == k) {
+                slot[k] = static_cast<uint32_t>(out);
+                if (out != k)
+                    members[out] = move(members[k]);
+                out++;
+            } else if (options.duplicate_keys == REJECT_DUPLICATES) {
+                error = "duplicate key \"" + members[k].first + "\" in object";
+                return false;
+            } else if (options.duplicate_keys == KEEP_LAST) {
+                members[slot[first[k]]].second = move(members[k].second);
+            }
+        }
+        members.erase(members.begin() + out, members.end());
+        return true;
+    }
+};
+}//namespace {
 
-            while (1) {
-                i--;
-                data.push_back(parse_json(depth + 1));
-                if (failed)
-                    return Json();
+/* parse_events(in, handler, err, options, stop_pos)
+ *
+ * Parse a single value spanning all of in, passing it to handler. If stop_pos is given, set
+ * it to the offset at which parsing stopped.
+ */
+template <class Handler>
+static bool parse_events(std::string_view in, Handler &handler, string &err,
+                         const JsonParseOptions &options, size_t *stop_pos = nullptr) {
+    JsonParser<Handler> parser { in, 0, err, false, options, handler, {} };
+    parser.parse_json();
 
-                ch = get_next_token();
-                if (ch == ']')
+    // Check for any trailing garbage
+    parser.consume_garbage();
+    if (!parser.failed && parser.i != in.size())
+        parser.fail("unexpected trailing " + esc(in[parser.i]));
+
+    if (stop_pos)
+        *stop_pos = parser.i;
+    return !parser.failed;
+}
+
+namespace {
+/* Validator
+ *
+ * Handler for Json::validate, which accepts every value and only has the input checked.
+ */
+struct Validator final {
+    static constexpr bool check_only = true;
+
+    bool on_null() { return true; }
+    bool on_bool(bool) { return true; }
+    bool on_number(const Json &) { return true; }
+    bool on_string(std::string_view) { return true; }
+    bool on_key(std::string_view) { return true; }
+    bool start_array() { return true; }
+    bool end_array() { return true; }
+    bool start_object() { return true; }
+    bool end_object() { return true; }
+};
+}//namespace {
+
+bool Json::validate(std::string_view in, string &err, size_t &err_pos,
+                    const JsonParseOptions &options) {
+    Validator validator;
+    return parse_events(in, validator, err, options, &err_pos);
+}
+
+/* find_escaped(backslash, carry)
+ *
+ * Return the mask of characters in a block that are escaped by a backslash, given the mask of
+ * backslashes in it. A character is escaped if it follows an odd-length run of backslashes.
+ * carry is set if the block ends in such a run, so that the next block's first character is
+ * escaped, and must be passed back in for that block.
+ */
+static uint64_t find_escaped(uint64_t backslash, uint64_t &carry) {
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    backslash &= ~carry;
+    const uint64_t follows_escape = backslash << 1 | carry;
+    // Add each run's start to the run: the carry out of the top of a run lands just past it,
+    // and whether it lands on an even or odd bit tells the run's parity.
+    const uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+    const uint64_t even_sums = odd_starts + backslash;
+    carry = even_sums < odd_starts;
+    const uint64_t invert = even_sums << 1;
+    return (even_bits ^ invert) & follows_escape;
+}
+
+/* prefix_xor(bits)
+ *
+ * Return a mask whose bit k is the XOR of bits 0 to k of bits. Applied to the unescaped quotes
+ * this marks everything from an opening quote up to, but not including, its closing quote.
+ */
+static uint64_t prefix_xor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+/* build_structural_index(in, index)
+ *
+ * Stage one of the STRUCTURAL_INDEX engine. Fill index with the position of every '{', '}',
+ * '[', ']', ':' and ',' outside strings, and of the first character of every string, number,
+ * literal or other run of non-whitespace between them, in order. Returns false if the input
+ * ends inside a string.
+ */
+static bool build_structural_index(std::string_view in, vector<uint32_t> &index) {
+    const auto classify = kernels().classify;
+    index.clear();
+    index.reserve(in.size() / 8 + 1);
+
+    uint64_t escape_carry = 0;
+    uint64_t string_carry = 0;
+    uint64_t scalar_carry = 0;
+    char tail[64];
+    for (size_t base = 0; base < in.size(); base += 64) {
+        const char *block = in.data() + base;
+        if (in.size() - base < 64) {
+            // Pad the last block with whitespace, which adds nothing to the index
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, in.size() - base);
+            block = tail;
+        }
+
+        BlockMasks masks;
+        classify(block, masks);
+        const uint64_t quote = masks.quote & ~find_escaped(masks.backslash, escape_carry);
+        const uint64_t in_string = prefix_xor(quote) ^ string_carry;
+        string_carry = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+        // A run of other characters starts wherever one follows an operator, whitespace or
+        // a closing quote. Everything after an opening quote, up to and including the closing
+        // quote, is string contents and is left out.
+        const uint64_t scalar = ~(masks.op | masks.whitespace);
+        const uint64_t unquoted_scalar = scalar & ~quote;
+        const uint64_t follows_scalar = unquoted_scalar << 1 | scalar_carry;
+        scalar_carry = unquoted_scalar >> 63;
+        const uint64_t string_tail = in_string ^ quote;
+        uint64_t structurals = (masks.op | (scalar & ~follows_scalar)) & ~string_tail;
+
+        size_t count = index.size();
+        index.resize(count + std::popcount(structurals));
+        for (; structurals; structurals &= structurals - 1)
+            index[count++] = static_cast<uint32_t>(base + std::countr_zero(structurals));
+    }
+    return string_carry == 0;
+}
+
+namespace {
+/* IndexedParser
+ *
+ * Stage two of the STRUCTURAL_INDEX engine: build a value from the structural index. It moves
+ * from one indexed position to the next instead of scanning for tokens, and hands strings and
+ * numbers to a JsonParser positioned on them. It gives up without a message on any error;
+ * the caller parses the input again with the recursive descent engine to report it.
+ */
+struct IndexedParser final {
+    JsonParser<JsonBuilder> &parser;
+    JsonBuilder &builder;
+    const vector<uint32_t> &index;
+    size_t next_index;
+
+    /* next()
+     *
+     * Move the parser to the next indexed position and return the character there, or 0 at
+     * the end of the index.
+     */
+    char next() {
+        if (next_index == index.size())
+            return 0;
+        parser.i = index[next_index++];
+        return parser.str[parser.i];
+    }
+
+    /* ends_token()
+     *
+     * Check that the scalar the parser just read is not followed by anything other than
+     * whitespace or the next indexed character.
+     */
+    bool ends_token() const {
+        const size_t i = parser.i;
+        return i == parser.str.size() || is_whitespace(parser.str[i])
+            || (next_index < index.size() && index[next_index] == i);
+    }
+
+    bool literal(std::string_view expected) {
+        if (parser.str.compare(parser.i, expected.size(), expected) != 0)
+            return false;
+        parser.i += expected.size();
+        return ends_token();
+    }
+
+    /* peek(ch)
+     *
+     * If the next indexed character is ch, move past it and return true.
+     */
+    bool peek(char ch) {
+        if (next_index == index.size() || parser.str[index[next_index]] != ch)
+            return false;
+        next_index++;
+        return true;
+    }
+
+    /* key(ch)
+     *
+     * Parse an object member's key, whose opening quote should be ch, and the ':' after it.
+     */
+    bool key(char ch) {
+        if (ch != '"')
+            return false;
+        parser.i++;
+        const std::string_view key = parser.parse_string();
+        return !parser.failed && builder.on_key(key) && next() == ':';
+    }
+
+    /* parse_json()
+     *
+     * Parse the value starting at the next indexed position. Like JsonParser::parse_json, it
+     * keeps the open arrays and objects on an explicit stack.
+     */
+    bool parse_json() {
+        NestingStack open;
+        char ch;
+        while (1) {
+            if (open.size() > parser.options.max_depth)
+                return false;
+
+            ch = next();
+            switch (ch) {
+            case 't':
+                if (!literal("true") || !builder.on_bool(true))
+                    return false;
+                break;
+            case 'f':
+                if (!literal("false") || !builder.on_bool(false))
+                    return false;
+                break;
+            case 'n':
+                if (!literal("null") || !builder.on_null())
+                    return false;
+                break;
+            case '"': {
+                parser.i++;
+                const std::string_view value = parser.parse_string();
+                if (parser.failed || !builder.on_string(value))
+                    return false;
+                break;
+            }
+            case '{':
+                if (!builder.start_object())
+                    return false;
+                if (peek('}')) {
+                    if (!builder.end_object())
+                        return false;
+                    break;
+                }
+                if (!key(next()))
+                    return false;
+                open.push(true);
+                continue;
+            case '[':
+                if (!builder.start_array())
+                    return false;
+                if (peek(']')) {
+                    if (!builder.end_array())
+                        return false;
                     break;
-                if (ch != ',')
-                    return fail("expected ',' in list, got " + esc(ch));
+                }
+                open.push(false);
+                continue;
+            default:
+                if (ch != '-' && (ch < '0' || ch > '9'))
+                    return false;
+                const Json number = parser.parse_number();
+                if (parser.failed || !ends_token() || !builder.on_number(number))
+                    return false;
+            }
 
-                ch = get_next_token();
-                (void)ch;
+            // Close the arrays and objects the value completes
+            while (1) {
+                if (open.empty())
+                    return true;
+                const bool object = open.top();
+                ch = next();
+                if (ch == (object ? '}' : ']')) {
+                    open.pop();
+                    if (!(object ? builder.end_object() : builder.end_array()))
+                        return false;
+                    continue;
+                }
+                if (ch != ',' || (object && !key(next())))
+                    return false;
+                break;
             }
-            return data;
         }
-
-        return fail("expected value, got " + esc(ch));
     }
 };
 }//namespace {
 
-Json Json::parse(const string &in, string &err, JsonParse strategy) {
-    JsonParser parser { in, 0, err, false, strategy };
-    Json result = parser.parse_json(0);
+/* parse_indexed(in, options, resource, out)
+ *
+ * Parse a single value spanning all of in with the STRUCTURAL_INDEX engine. Returns false,
+ * leaving out unchanged, if the input is not valid or is too large to index.
+ */
+static bool parse_indexed(std::string_view in, const JsonParseOptions &options,
+                          std::pmr::memory_resource *resource, Json &out) {
+    if (in.size() > std::numeric_limits<uint32_t>::max())
+        return false;
+    vector<uint32_t> index;
+    if (!build_structural_index(in, index))
+        return false;
 
-    // Check for any trailing garbage
-    parser.consume_garbage();
-    if (parser.failed)
+    string err;
+    JsonBuilder builder(resource, options);
+    JsonParser<JsonBuilder> parser { in, 0, err, false, options, builder, {} };
+    IndexedParser indexed { parser, builder, index, 0 };
+    if (!indexed.parse_json() || indexed.next_index != index.size())
+        return false;
+    out = move(builder.root);
+    return true;
+}
+
+/* parse_value(in, err, options, resource)
+ *
+ * Parse a single value spanning all of in, allocating its nodes from resource.
+ */
+static Json parse_value(std::string_view in, string &err, const JsonParseOptions &options,
+                        std::pmr::memory_resource *resource) {
+    if (options.engine == STRUCTURAL_INDEX && options.strategy == STANDARD) {
+        Json value;
+        if (parse_indexed(in, options, resource, value))
+            return value;
+    }
+
+    JsonBuilder builder(resource, options);
+    if (!parse_events(in, builder, err, options))
         return Json();
-    if (parser.i != in.size())
-        return parser.fail("unexpected trailing " + esc(in[parser.i]));
+    return move(builder.root);
+}
+
+Json Json::parse(std::string_view in, string &err, const JsonParseOptions &options) {
+    return parse_value(in, err, options, nullptr);
+}
+
+Json Json::parse(std::string_view in, string &err, const JsonParseOptions &options,
+                 std::pmr::memory_resource *resource) {
+    return parse_value(in, err, options, resource);
+}
 
-    return result;
+bool Json::parse(std::string_view in, JsonHandler &handler, string &err,
+                 const JsonParseOptions &options) {
+    return parse_events(in, handler, err, options);
 }
 
-Json Json::try_parse(const string &in, JsonParse strategy) {
+Json Json::try_parse(std::string_view in, const JsonParseOptions &options) {
     std::string err;
 
-    Json output = Json::parse(in, err, strategy);
+    Json output = Json::parse(in, err, options);
 
     if (!err.empty())
         throw JsonException(err);
@@ -778,17 +2185,20 @@ Json Json::try_parse(const string &in, JsonParse strategy) {
 }
 
 // Documented in json11.hpp
-vector<Json> Json::parse_multi(const string &in,
+vector<Json> Json::parse_multi(std::string_view in,
                                std::string::size_type &parser_stop_pos,
                                string &err,
-                               JsonParse strategy) {
-    JsonParser parser { in, 0, err, false, strategy };
+                               const JsonParseOptions &options) {
+    JsonBuilder builder(nullptr, options);
+    JsonParser<JsonBuilder> parser { in, 0, err, false, options, builder, {} };
     parser_stop_pos = 0;
     vector<Json> json_vec;
     while (parser.i != in.size() && !parser.failed) {
-        json_vec.push_back(parser.parse_json(0));
-        if (parser.failed)
+        if (!parser.parse_json()) {
+            json_vec.push_back(Json());
             break;
+        }
+        json_vec.push_back(move(builder.root));
 
         // Check for another object
         parser.consume_garbage();
@@ -799,6 +2209,871 @@ vector<Json> Json::parse_multi(const string &in,
     return json_vec;
 }
 
+/* * * * * * * * * * * * * * * * * * * *
+ * Stream parsing
+ *
+ * JsonStreamParser frames the input: a small state machine, kept across chunks, finds where
+ * each top-level value ends by tracking strings, escapes, comments and bracket depth, and for
+ * top-level numbers and literals, the scalar grammar. It does not otherwise check the grammar;
+ * each framed value, and any junk between values, goes to the parser, which reports errors
+ * with its usual messages.
+ */
+
+JsonStreamParser::JsonStreamParser(const JsonParseOptions &options) : m_options(options) {}
+
+bool JsonStreamParser::feed(std::string_view chunk) {
+    if (failed() || m_finished)
+        return !failed();
+
+    // Scan the chunk in place unless an unfinished value is waiting for it.
+    std::string_view data = chunk;
+    if (!m_buffer.empty()) {
+        m_buffer.append(chunk);
+        data = m_buffer;
+    }
+    scan(data);
+    if (failed())
+        return false;
+
+    // Keep only the unfinished value.
+    const size_t keep_from = m_value_start == string::npos ? data.size() : m_value_start;
+    if (data.data() == m_buffer.data())
+        m_buffer.erase(0, keep_from);
+    else
+        m_buffer.assign(data.substr(keep_from));
+    m_scanned -= keep_from;
+    if (m_value_start != string::npos)
+        m_value_start = 0;
+    return true;
+}
+
+bool JsonStreamParser::finish() {
+    if (failed() || m_finished)
+        return !failed();
+    m_finished = true;
+
+    if (m_state == State::LITERAL || m_state == State::NUMBER_INTEGER
+            || m_state == State::NUMBER_FRACTION || m_state == State::NUMBER_EXPONENT) {
+        complete(m_buffer, m_buffer.size());
+    } else if (m_state != State::BETWEEN
+               && !(m_state == State::LINE_COMMENT && m_depth == 0)) {
+        // The input ended inside a value or comment: let the parser say where.
+        string err;
+        parse_value(std::string_view(m_buffer).substr(m_value_start), err, m_options, nullptr);
+        m_error = err.empty() ? "unexpected end of input" : move(err);
+    }
+    m_buffer.clear();
+    return !failed();
+}
+
+bool JsonStreamParser::next(Json &value) {
+    if (m_next == m_values.size())
+        return false;
+    value = move(m_values[m_next++]);
+    if (m_next == m_values.size()) {
+        m_values.clear();
+        m_next = 0;
+    }
+    return true;
+}
+
+/* scan(data)
+ *
+ * Advance the framing state over data from m_scanned to its end, parsing each value that
+ * ends on the way.
+ */
+void JsonStreamParser::scan(std::string_view data) {
+    const bool comments = m_options.strategy == JsonParse::COMMENTS;
+    size_t i = m_scanned;
+    while (i < data.size()) {
+        const char ch = data[i];
+        switch (m_state) {
+            case State::BETWEEN:
+                if (is_whitespace(ch)) {
+                    i += 1 + kernels().skip_whitespace(data.data() + i + 1, data.size() - i - 1);
+                    break;
+                }
+                m_value_start = i++;
+                if (ch == '"') {
+                    m_state = State::STRING;
+                } else if (ch == '[' || ch == '{') {
+                    m_state = State::VALUE;
+                    m_depth = 1;
+                } else if (ch == '/' && comments) {
+                    m_state = State::SLASH;
+                } else if (ch == 't' || ch == 'f' || ch == 'n') {
+                    m_state = State::LITERAL;
+                } else if (ch == '-' || in_range(ch, '0', '9')) {
+                    m_state = State::NUMBER_INTEGER;
+                } else {
+                    // Cannot start a value; the parser reports it.
+                    if (!complete(data, i))
+                        return;
+                }
+                break;
+
+            case State::LITERAL: {
+                const std::string_view literal = data[m_value_start] == 't' ? "true"
+                                               : data[m_value_start] == 'f' ? "false" : "null";
+                i = std::min(data.size(), m_value_start + literal.size());
+                if (i - m_value_start < literal.size())
+                    break;
+                // On a mismatch, let the parser report it from the rest of the input.
+                if (data.substr(m_value_start, literal.size()) != literal)
+                    i = data.size();
+                if (!complete(data, i))
+                    return;
+                break;
+            }
+
+            case State::NUMBER_INTEGER:
+            case State::NUMBER_FRACTION:
+            case State::NUMBER_EXPONENT: {
+                // Follow the number grammar to find where the number ends, as the parser does.
+                // A byte that cannot follow the previous one makes the number malformed; the
+                // parser then reports it from the rest of the input.
+                const char prev = data[i - 1];
+                const bool digit = in_range(ch, '0', '9');
+                bool malformed = false;
+                if (prev == '-' || prev == '+' || prev == '.') {
+                    malformed = !digit;
+                } else if (prev == 'e' || prev == 'E') {
+                    malformed = !digit && ch != '-' && ch != '+';
+                } else if (digit) {
+                    // Only a leading zero may not be followed by a digit.
+                    malformed = m_state == State::NUMBER_INTEGER && prev == '0'
+                        && (i - 1 == m_value_start || data[i - 2] == '-');
+                } else if (ch == '.' && m_state == State::NUMBER_INTEGER) {
+                    m_state = State::NUMBER_FRACTION;
+                } else if ((ch == 'e' || ch == 'E') && m_state != State::NUMBER_EXPONENT) {
+                    m_state = State::NUMBER_EXPONENT;
+                } else {
+                    // The number ended before ch.
+                    if (!complete(data, i))
+                        return;
+                    break;
+                }
+
+                if (malformed) {
+                    complete(data, data.size());
+                    return;
+                }
+                i++;
+                break;
+            }
+
+            case State::VALUE:
+                i++;
+                if (ch == '"') {
+                    m_state = State::STRING;
+                } else if (ch == '[' || ch == '{') {
+                    m_depth++;
+                } else if (ch == ']' || ch == '}') {
+                    if (--m_depth == 0 && !complete(data, i))
+                        return;
+                } else if (ch == '/' && comments) {
+                    m_state = State::SLASH;
+                }
+                break;
+
+            case State::STRING:
+                i += kernels().scan_string(data.data() + i, data.size() - i);
+                if (i == data.size())
+                    break;
+                if (data[i] == '"') {
+                    i++;
+                    if (m_depth != 0)
+                        m_state = State::VALUE;
+                    else if (!complete(data, i))
+                        return;
+                } else {
+                    // A backslash, or a control character that the parser will reject.
+                    if (data[i] == '\\')
+                        m_state = State::STRING_ESCAPE;
+                    i++;
+                }
+                break;
+
+            case State::STRING_ESCAPE:
+                m_state = State::STRING;
+                i++;
+                break;
+
+            case State::SLASH:
+                if (ch == '/' || ch == '*') {
+                    m_state = ch == '/' ? State::LINE_COMMENT : State::BLOCK_COMMENT;
+                    i++;
+                } else if (m_depth == 0) {
+                    // A malformed comment between values; the parser reports it.
+                    if (!complete(data, i + 1))
+                        return;
+                    i++;
+                } else {
+                    m_state = State::VALUE;
+                }
+                break;
+
+            case State::LINE_COMMENT:
+                i++;
+                if (ch == '\n')
+                    end_comment();
+                break;
+
+            case State::BLOCK_COMMENT:
+                i++;
+                if (ch == '*')
+                    m_state = State::BLOCK_COMMENT_STAR;
+                break;
+
+            case State::BLOCK_COMMENT_STAR:
+                i++;
+                if (ch == '/')
+                    end_comment();
+                else if (ch != '*')
+                    m_state = State::BLOCK_COMMENT;
+                break;
+        }
+    }
+    m_scanned = i;
+}
+
+/* complete(data, end)
+ *
+ * Parse the value that starts at m_value_start and ends at end, and go back to looking for
+ * the next one. On a parse error, record it and return false.
+ */
+bool JsonStreamParser::complete(std::string_view data, size_t end) {
+    string err;
+    Json value = parse_value(data.substr(m_value_start, end - m_value_start), err, m_options,
+                             nullptr);
+    if (!err.empty()) {
+        m_error = move(err);
+        return false;
+    }
+    m_values.push_back(move(value));
+    m_state = State::BETWEEN;
+    m_depth = 0;
+    m_value_start = string::npos;
+    return true;
+}
+
+void JsonStreamParser::end_comment() {
+    if (m_depth != 0) {
+        m_state = State::VALUE;
+    } else {
+        // Comments between values are dropped.
+        m_state = State::BETWEEN;
+        m_value_start = string::npos;
+    }
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Documents
+ */
+
+/* JsonDocument::Arena
+ *
+ * Bump allocator backing a JsonDocument; individual deallocations are ignored. reset()
+ * rewinds the arena, first coalescing its chunks into one chunk as large as all of them, so
+ * a document of similar size fits next time without growing again.
+ */
+struct JsonDocument::Arena final : std::pmr::memory_resource {
+    static const size_t min_chunk_size = 4096;
+
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    vector<Chunk> chunks;
+    size_t used = 0; // bytes used in chunks.back()
+#ifndef NDEBUG
+    // Allocations not yet deallocated. Every node and container from the arena must be gone
+    // by the time it is reset; a Json copied out of the document would be left dangling.
+    size_t live = 0;
+#endif
+
+    void * do_allocate(size_t bytes, size_t alignment) override {
+        if (!chunks.empty()) {
+            Chunk &chunk = chunks.back();
+            void * p = chunk.data.get() + used;
+            size_t space = chunk.size - used;
+            if (std::align(alignment, bytes, p, space)) {
+                used = chunk.size - space + bytes;
+#ifndef NDEBUG
+                live++;
+#endif
+                return p;
+            }
+        }
+
+        const size_t size = std::max({ min_chunk_size, bytes + alignment,
+                                       chunks.empty() ? 0 : chunks.back().size * 2 });
+        chunks.push_back({ std::unique_ptr<char[]>(new char[size]), size });
+        used = 0;
+        return do_allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {
+#ifndef NDEBUG
+        live--;
+#endif
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    void reset() {
+        assert(live == 0 && "a Json from this JsonDocument outlived its contents");
+        if (chunks.size() > 1) {
+            size_t size = 0;
+            for (const auto &chunk : chunks)
+                size += chunk.size;
+            chunks.clear();
+            chunks.push_back({ std::unique_ptr<char[]>(new char[size]), size });
+        }
+        used = 0;
+    }
+};
+
+JsonDocument::JsonDocument() : m_arena(new Arena()) {}
+JsonDocument::~JsonDocument() {
+    clear();
+}
+
+const Json & JsonDocument::parse(std::string_view in, string &err, const JsonParseOptions &options) {
+    clear();
+    m_root = parse_value(in, err, options, m_arena.get());
+    return m_root;
+}
+
+void JsonDocument::clear() {
+    m_root = Json();
+    m_arena->reset();
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Lazy documents
+ */
+
+bool JsonLazyDocument::parse(std::string_view in, string &err) {
+    m_input = in;
+    const auto fail = [&](string &&msg) {
+        m_index.clear();
+        m_next.clear();
+        err = move(msg);
+        return false;
+    };
+
+    if (in.size() > std::numeric_limits<uint32_t>::max())
+        return fail("input too large to index");
+    if (!build_structural_index(in, m_index))
+        return fail("unexpected end of input in string");
+    if (m_index.empty())
+        return fail("unexpected end of input");
+
+    // Match up brackets. The value starting at an opening bracket ends after its closing one;
+    // any other value ends where it starts, since its contents are not indexed.
+    m_next.resize(m_index.size());
+    vector<uint32_t> open;
+    for (uint32_t k = 0; k < m_index.size(); k++) {
+        const char ch = in[m_index[k]];
+        m_next[k] = k + 1;
+        if (ch == '[' || ch == '{') {
+            open.push_back(k);
+        } else if (ch == ']' || ch == '}') {
+            // ']' and '}' are two past '[' and '{'
+            if (open.empty() || in[m_index[open.back()]] != ch - 2)
+                return fail("unexpected " + esc(ch));
+            m_next[open.back()] = k + 1;
+            open.pop_back();
+        }
+        if (open.empty() && k + 1 < m_index.size())
+            return fail("unexpected trailing " + esc(in[m_index[k + 1]]));
+    }
+    if (!open.empty())
+        return fail("unexpected end of input");
+    return true;
+}
+
+JsonLazyValue JsonLazyDocument::root() const {
+    return m_index.empty() ? JsonLazyValue() : JsonLazyValue(this, 0);
+}
+
+namespace {
+/* LazyDecoder
+ *
+ * A JsonParser over a lazy document's input, for decoding its strings and scalars one at a
+ * time. Errors are thrown.
+ */
+struct LazyDecoder final {
+    string err;
+    JsonHandler ignore;
+    JsonParser<JsonHandler> parser;
+
+    explicit LazyDecoder(std::string_view in) : parser { in, 0, err, false, {}, ignore, {} } {}
+
+    void check() const {
+        if (parser.failed)
+            throw JsonException(err);
+    }
+
+    // Decode the string whose opening quote is at pos. The result is valid until the next
+    // call.
+    std::string_view string_at(size_t pos) {
+        parser.i = pos + 1;
+        const std::string_view value = parser.parse_string();
+        check();
+        return value;
+    }
+};
+}//namespace {
+
+/* token(k)
+ *
+ * Return the character at position k of the structural index, or 0 past its end.
+ */
+char JsonLazyValue::token(uint32_t k) const {
+    const auto &index = m_doc->m_index;
+    return k < index.size() ? m_doc->m_input[index[k]] : static_cast<char>(0);
+}
+
+/* skip(k)
+ *
+ * Return the position just past the value starting at position k of the structural index.
+ */
+uint32_t JsonLazyValue::skip(uint32_t k) const {
+    const char ch = token(k);
+    if (ch == ']' || ch == '}' || ch == ',' || ch == ':' || ch == 0)
+        throw JsonException("expected value, got " + esc(ch));
+    return m_doc->m_next[k];
+}
+
+/* member_value(key)
+ *
+ * Return the position of the value of the member whose key is at position key.
+ */
+uint32_t JsonLazyValue::member_value(uint32_t key) const {
+    if (token(key) != '"')
+        throw JsonException("expected '\"' in object, got " + esc(token(key)));
+    if (token(key + 1) != ':')
+        throw JsonException("expected ':' in object, got " + esc(token(key + 1)));
+    return key + 2;
+}
+
+/* first(open)
+ *
+ * Return the position of the first element, or first member value, of this array or object,
+ * which is opened by open, or npos if it is empty.
+ */
+uint32_t JsonLazyValue::first(char open) const {
+    if (token(m_index + 1) == open + 2)
+        return npos;
+    return open == '{' ? member_value(m_index + 1) : m_index + 1;
+}
+
+/* next_element(k, object)
+ *
+ * Return the position of the element or member value after the one at position k, or npos
+ * if it was the last.
+ */
+uint32_t JsonLazyValue::next_element(uint32_t k, bool object) const {
+    k = skip(k);
+    const char ch = token(k);
+    if (ch == (object ? '}' : ']'))
+        return npos;
+    if (ch != ',')
+        throw JsonException(string("expected ',' in ") + (object ? "object" : "list") + ", got "
+                            + esc(ch));
+    if (object)
+        return member_value(k + 1);
+    if (token(k + 1) == ']')
+        throw JsonException("expected value, got " + esc(']'));
+    return k + 1;
+}
+
+/* scalar()
+ *
+ * Decode this value if it is a number or literal, or return Json() otherwise.
+ */
+Json JsonLazyValue::scalar() const {
+    if (!m_doc)
+        return Json();
+    const char ch = token(m_index);
+    LazyDecoder decoder(m_doc->m_input);
+    auto &parser = decoder.parser;
+    parser.i = m_doc->m_index[m_index];
+
+    Json value;
+    if (ch == '-' || (ch >= '0' && ch <= '9')) {
+        value = parser.parse_number();
+    } else if (ch == 't' || ch == 'f' || ch == 'n') {
+        parser.i++;
+        parser.expect(ch == 't' ? "true" : ch == 'f' ? "false" : "null");
+        if (ch != 'n')
+            value = ch == 't';
+    } else if (ch == '"' || ch == '[' || ch == '{') {
+        return Json();
+    } else {
+        throw JsonException("expected value, got " + esc(ch));
+    }
+
+    // The value must run up to whitespace or the next indexed character
+    const auto &index = m_doc->m_index;
+    const size_t end = parser.i;
+    if (!parser.failed && end < m_doc->m_input.size() && !is_whitespace(m_doc->m_input[end])
+        && !(m_index + 1 < index.size() && index[m_index + 1] == end))
+        parser.fail("unexpected " + esc(m_doc->m_input[end]) + " after value");
+    decoder.check();
+    return value;
+}
+
+Json::Type JsonLazyValue::type() const {
+    if (!m_doc)
+        return Json::NUL;
+    const char ch = token(m_index);
+    switch (ch) {
+    case '{': return Json::OBJECT;
+    case '[': return Json::ARRAY;
+    case '"': return Json::STRING;
+    case 't': case 'f': return Json::BOOL;
+    case 'n': return Json::NUL;
+    default:
+        if (ch == '-' || (ch >= '0' && ch <= '9'))
+            return Json::NUMBER;
+        throw JsonException("expected value, got " + esc(ch));
+    }
+}
+
+double JsonLazyValue::number_value() const { return scalar().number_value(); }
+int JsonLazyValue::int_value() const { return scalar().int_value(); }
+int64_t JsonLazyValue::int64_value() const { return scalar().int64_value(); }
+uint64_t JsonLazyValue::uint64_value() const { return scalar().uint64_value(); }
+bool JsonLazyValue::bool_value() const { return scalar().bool_value(); }
+
+string JsonLazyValue::string_value() const {
+    if (type() != Json::STRING) throw JsonException("not a string");
+    return string(LazyDecoder(m_doc->m_input).string_at(m_doc->m_index[m_index]));
+}
+
+string JsonLazyValue::key() const {
+    if (!m_doc || m_index < 2 || token(m_index - 1) != ':')
+        throw JsonException("not an object member");
+    return JsonLazyValue(m_doc, m_index - 2).string_value();
+}
+
+JsonLazyValue::items JsonLazyValue::array_items() const {
+    if (type() != Json::ARRAY) throw JsonException("not an array");
+    return { iterator(m_doc, first('['), false), iterator(m_doc, npos, false) };
+}
+
+JsonLazyValue::items JsonLazyValue::object_items() const {
+    if (type() != Json::OBJECT) throw JsonException("not an object");
+    return { iterator(m_doc, first('{'), true), iterator(m_doc, npos, true) };
+}
+
+JsonLazyValue::iterator &JsonLazyValue::iterator::operator++() {
+    m_value = JsonLazyValue(m_doc, m_value).next_element(m_value, m_object);
+    return *this;
+}
+
+size_t JsonLazyValue::size() const {
+    const items range = is_object() ? object_items() : array_items();
+    size_t count = 0;
+    for (auto it = range.begin(); it != range.end(); ++it)
+        count++;
+    return count;
+}
+
+JsonLazyValue JsonLazyValue::operator[](size_t i) const {
+    if (type() != Json::ARRAY) throw JsonException("not an array");
+    uint32_t k = first('[');
+    for (; k != npos && i; i--)
+        k = next_element(k, false);
+    if (k == npos) throw JsonException("index out of bounds");
+    return JsonLazyValue(m_doc, k);
+}
+
+JsonLazyValue JsonLazyValue::operator[](std::string_view key) const {
+    if (type() != Json::OBJECT) throw JsonException("not an object");
+    LazyDecoder decoder(m_doc->m_input);
+    for (uint32_t k = first('{'); k != npos; k = next_element(k, true)) {
+        if (decoder.string_at(m_doc->m_index[k - 2]) == key)
+            return JsonLazyValue(m_doc, k);
+    }
+    throw JsonException("invalid key");
+}
+
+std::string_view JsonLazyValue::text() const {
+    if (!m_doc)
+        return {};
+    const auto &index = m_doc->m_index;
+    const size_t start = index[m_index];
+    const char ch = token(m_index);
+    if (ch == '[' || ch == '{')
+        return m_doc->m_input.substr(start, index[m_doc->m_next[m_index] - 1] + 1 - start);
+
+    // Anything else runs up to the next indexed character, less the whitespace before it
+    size_t end = m_index + 1 < index.size() ? index[m_index + 1] : m_doc->m_input.size();
+    while (end > start + 1 && is_whitespace(m_doc->m_input[end - 1]))
+        end--;
+    return m_doc->m_input.substr(start, end - start);
+}
+
+Json JsonLazyValue::decode() const {
+    if (!m_doc)
+        return Json();
+    return Json::try_parse(text());
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Projection
+ */
+
+struct JsonProjection::Node {
+    std::map<string, std::unique_ptr<Node>, std::less<>> children;
+    std::unique_ptr<Node> wildcard;
+    // A pointer ends here, so the whole value is kept.
+    bool whole = false;
+
+    // Return the node for the member or element named key, or null if it is not selected.
+    const Node *child(std::string_view key) const {
+        const auto it = children.find(key);
+        return it != children.end() ? it->second.get() : wildcard.get();
+    }
+};
+
+/* merge(into, from)
+ *
+ * Add everything that from selects to into.
+ */
+static void merge(JsonProjection::Node &into, const JsonProjection::Node &from) {
+    into.whole |= from.whole;
+    for (const auto &kv : from.children) {
+        auto &child = into.children[kv.first];
+        if (!child)
+            child.reset(new JsonProjection::Node());
+        merge(*child, *kv.second);
+    }
+    if (from.wildcard) {
+        if (!into.wildcard)
+            into.wildcard.reset(new JsonProjection::Node());
+        merge(*into.wildcard, *from.wildcard);
+    }
+}
+
+/* resolve_wildcards(node)
+ *
+ * A member or element matched by name is also matched by a "*" beside it, so give each named
+ * child everything its wildcard sibling selects. Lookups can then stop at the first match.
+ */
+static void resolve_wildcards(JsonProjection::Node &node) {
+    for (auto &kv : node.children) {
+        if (node.wildcard)
+            merge(*kv.second, *node.wildcard);
+        resolve_wildcards(*kv.second);
+    }
+    if (node.wildcard)
+        resolve_wildcards(*node.wildcard);
+}
+
+JsonProjection::JsonProjection(std::initializer_list<std::string_view> pointers)
+    : m_root(new Node()) {
+    for (std::string_view pointer : pointers)
+        add(pointer);
+    resolve_wildcards(*m_root);
+}
+
+JsonProjection::JsonProjection(const vector<string> &pointers) : m_root(new Node()) {
+    for (const string &pointer : pointers)
+        add(pointer);
+    resolve_wildcards(*m_root);
+}
+
+JsonProjection::JsonProjection(JsonProjection &&) noexcept = default;
+JsonProjection &JsonProjection::operator=(JsonProjection &&) noexcept = default;
+JsonProjection::~JsonProjection() {}
+
+void JsonProjection::add(std::string_view pointer) {
+    const auto invalid = [&] {
+        return JsonException("invalid JSON pointer \"" + string(pointer) + "\"");
+    };
+    if (!pointer.empty() && pointer[0] != '/')
+        throw invalid();
+
+    Node *node = m_root.get();
+    for (size_t pos = 0; pos < pointer.size();) {
+        size_t end = pointer.find('/', pos + 1);
+        if (end == std::string_view::npos)
+            end = pointer.size();
+        const std::string_view segment = pointer.substr(pos + 1, end - pos - 1);
+        pos = end;
+
+        std::unique_ptr<Node> *child;
+        if (segment == "*") {
+            child = &node->wildcard;
+        } else {
+            // "~1" stands for '/' and "~0" for '~'
+            string key;
+            for (size_t k = 0; k < segment.size(); k++) {
+                if (segment[k] != '~') {
+                    key += segment[k];
+                } else if (k + 1 < segment.size() && (segment[k + 1] == '0' || segment[k + 1] == '1')) {
+                    key += segment[++k] == '0' ? '~' : '/';
+                } else {
+                    throw invalid();
+                }
+            }
+            child = &node->children[key];
+        }
+        if (!*child)
+            child->reset(new Node());
+        node = child->get();
+    }
+    node->whole = true;
+}
+
+namespace {
+/* ProjectingBuilder
+ *
+ * Handler that passes the events for the parts of the input that a projection selects on to
+ * a JsonBuilder, and drops the rest. Inside a value that is dropped or kept whole, it only
+ * counts brackets.
+ */
+struct ProjectingBuilder final {
+    using Node = JsonProjection::Node;
+
+    struct Frame {
+        // Selects the members or elements of the container.
+        const Node *node;
+        // Elements of an array seen so far.
+        size_t count;
+        bool object;
+    };
+
+    const Node &root;
+    JsonBuilder builder;
+    string error;
+
+    std::pmr::vector<Frame> frames;
+    // How deeply nested the parser is inside a dropped value, or a value kept whole.
+    size_t dropped = 0;
+    size_t whole = 0;
+    // The node for the value of the member whose key was just read, and that key.
+    const Node *member = nullptr;
+    string key;
+
+    ProjectingBuilder(const Node &root, const JsonParseOptions &options)
+        : root(root), builder(nullptr, options) {}
+
+    bool check(bool ok) {
+        if (!ok)
+            error = move(builder.error);
+        return ok;
+    }
+
+    /* select()
+     *
+     * Return the node selecting the value that is starting, or null if it is to be dropped.
+     */
+    const Node *select() {
+        if (frames.empty())
+            return &root;
+        Frame &top = frames.back();
+        if (top.object)
+            return member;
+        char buf[24];
+        const auto result = std::to_chars(buf, buf + sizeof(buf), top.count++);
+        return top.node->child(std::string_view(buf, result.ptr - buf));
+    }
+
+    /* keep()
+     *
+     * Pass on the key of the value that is starting, if it is an object member.
+     */
+    bool keep() {
+        return frames.empty() || !frames.back().object || check(builder.on_key(key));
+    }
+
+    template <class Emit>
+    bool scalar(Emit &&emit) {
+        if (dropped)
+            return true;
+        if (whole)
+            return check(emit());
+        const Node *node = select();
+        if (!node || !node->whole)
+            return true;
+        return keep() && check(emit());
+    }
+
+    bool start(bool object) {
+        if (dropped) {
+            dropped++;
+            return true;
+        }
+        if (!whole) {
+            const Node *node = select();
+            if (!node) {
+                dropped = 1;
+                return true;
+            }
+            if (!keep())
+                return false;
+            if (node->whole)
+                whole = 1;
+            else
+                frames.push_back({ node, 0, object });
+        } else {
+            whole++;
+        }
+        return check(object ? builder.start_object() : builder.start_array());
+    }
+
+    bool end(bool object) {
+        if (dropped) {
+            dropped--;
+            return true;
+        }
+        if (whole)
+            whole--;
+        else
+            frames.pop_back();
+        return check(object ? builder.end_object() : builder.end_array());
+    }
+
+    bool on_null() { return scalar([&] { return builder.on_null(); }); }
+    bool on_bool(bool b) { return scalar([&] { return builder.on_bool(b); }); }
+    bool on_number(const Json &number) { return scalar([&] { return builder.on_number(number); }); }
+    bool on_string(std::string_view s) { return scalar([&] { return builder.on_string(s); }); }
+
+    bool on_key(std::string_view k) {
+        if (dropped)
+            return true;
+        if (whole)
+            return check(builder.on_key(k));
+        member = frames.back().node->child(k);
+        if (member)
+            key.assign(k);
+        return true;
+    }
+
+    bool start_array() { return start(false); }
+    bool end_array() { return end(false); }
+    bool start_object() { return start(true); }
+    bool end_object() { return end(true); }
+};
+}//namespace {
+
+Json Json::parse(std::string_view in, const JsonProjection &projection, string &err,
+                 const JsonParseOptions &options) {
+    ProjectingBuilder handler(*projection.m_root, options);
+    if (!parse_events(in, handler, err, options))
+        return Json();
+    return move(handler.builder.root);
+}
+
 /* * * * * * * * * * * * * * * * * * * *
  * Shape-checking
  */
@@ -821,11 +3096,133 @@ bool Json::has_shape(const shape & types, string & err) const {
     return true;
 }
 
-// Json& operator[](const std::string& key);
+/* Json::object::Index
+ *
+ * Open-addressing hash table from keys to member positions. Each slot caches the hash of its
+ * key, so probing only compares strings whose hashes match. Like a linear scan, the index
+ * resolves a repeated key to its first occurrence.
+ */
+struct Json::object::Index {
+    struct Slot {
+        uint32_t hash;
+        uint32_t position; // member position + 1, or 0 for an empty slot
+    };
+
+    // On the global heap rather than the object's memory resource: a const lookup may build
+    // the index, and resources such as a JsonDocument's arena are not thread-safe.
+    vector<Slot> slots;
+    size_t used = 0;
+
+    static uint32_t hash(std::string_view key) {
+        return static_cast<uint32_t>(std::hash<std::string_view>()(key));
+    }
+
+    // Return the position of key in members, or members.size() if it is not present.
+    size_t find(const std::pmr::vector<value_type> &members, std::string_view key) const {
+        const uint32_t h = hash(key);
+        const size_t mask = slots.size() - 1;
+        for (size_t i = h & mask;; i = (i + 1) & mask) {
+            const Slot &slot = slots[i];
+            if (!slot.position)
+                return members.size();
+            if (slot.hash == h && members[slot.position - 1].first == key)
+                return slot.position - 1;
+        }
+    }
+
+    // Index the member at position, unless its key is already indexed.
+    void add(const std::pmr::vector<value_type> &members, size_t position) {
+        if ((used + 1) * 2 > slots.size())
+            rehash(std::max<size_t>(slots.size() * 2, 64));
+
+        const string &key = members[position].first;
+        const uint32_t h = hash(key);
+        const size_t mask = slots.size() - 1;
+        for (size_t i = h & mask;; i = (i + 1) & mask) {
+            Slot &slot = slots[i];
+            if (!slot.position) {
+                slot = { h, static_cast<uint32_t>(position + 1) };
+                used++;
+                return;
+            }
+            if (slot.hash == h && members[slot.position - 1].first == key)
+                return;
+        }
+    }
+
+    // Resize the table to capacity slots, which must be a power of two.
+    void rehash(size_t capacity) {
+        vector<Slot> old(capacity, Slot { 0, 0 });
+        old.swap(slots);
+        const size_t mask = capacity - 1;
+        for (const Slot &slot : old) {
+            if (!slot.position)
+                continue;
+            size_t i = slot.hash & mask;
+            while (slots[i].position)
+                i = (i + 1) & mask;
+            slots[i] = slot;
+        }
+    }
+};
+
+// Objects up to this size are searched linearly.
+static const size_t object_index_threshold = 16;
+
+const Json::object::Index * Json::object::index() const {
+    if (Index *index = m_index.load(std::memory_order_acquire))
+        return index;
+    if (m_data.size() <= object_index_threshold)
+        return nullptr;
+
+    // Lookups on a shared const object may race to build the index; the first one wins.
+    Index *index = new Index();
+    index->rehash(std::bit_ceil(std::max<size_t>(m_data.size() * 2, 64)));
+    for (size_t i = 0; i < m_data.size(); i++)
+        index->add(m_data, i);
+
+    Index *expected = nullptr;
+    if (!m_index.compare_exchange_strong(expected, index, std::memory_order_acq_rel)) {
+        delete index;
+        return expected;
+    }
+    return index;
+}
+
+void Json::object::reset_index() {
+    delete m_index.exchange(nullptr, std::memory_order_relaxed);
+}
+
+size_t Json::object::position(std::string_view key) const {
+    if (const Index *index = this->index())
+        return index->find(m_data, key);
+    for (size_t i = 0; i < m_data.size(); i++) {
+        if (m_data[i].first == key) return i;
+    }
+    return m_data.size();
+}
 
 Json::object::object(const object& object) : m_data(object.m_data) {}
-Json::object::object(object&& object) : m_data(std::move(object.m_data)) {}
+Json::object::object(object&& object) : m_data(std::move(object.m_data)) { object.reset_index(); }
 Json::object::object(std::initializer_list<value_type> init) : m_data(init) {}
+Json::object::~object() { reset_index(); }
+
+Json::object& Json::object::operator=(const object& other) {
+    if (this != &other) {
+        reset_index();
+        m_data = other.m_data;
+    }
+    return *this;
+}
+
+Json::object& Json::object::operator=(object&& other) {
+    if (this != &other) {
+        reset_index();
+        other.reset_index();
+        m_data = std::move(other.m_data);
+    }
+    return *this;
+}
 
 Json::object::iterator Json::object::begin() { return m_data.begin(); }
 Json::object::iterator Json::object::end() { return m_data.end(); }
@@ -834,23 +3231,46 @@ Json::object::const_iterator Json::object::end() const { return m_data.end(); }
 Json::object::const_iterator Json::object::cbegin() const { return m_data.cbegin(); }
 Json::object::const_iterator Json::object::cend() const { return m_data.cend(); }
 
-bool Json::object::operator==(const Json::object& other) const { return m_data == other.m_data; }
-bool Json::object::operator<(const Json::object& other) const { return m_data < other.m_data; }
+/* sorted_members(object)
+ *
+ * The members of object in key order, keeping the insertion order of repeated keys. Objects
+ * compare as their members in this order, so that, as when objects were std::maps, two objects
+ * with the same members are equal whatever order they were inserted in.
+ */
+static vector<const Json::object::value_type *> sorted_members(const Json::object &object) {
+    vector<const Json::object::value_type *> members;
+    members.reserve(object.size());
+    for (const auto &member : object)
+        members.push_back(&member);
+    std::stable_sort(members.begin(), members.end(), [](const auto *a, const auto *b) {
+        return a->first < b->first;
+    });
+    return members;
+}
 
-Json::object::iterator Json::object::find(const std::string& key) {
-    auto end = this->end();
-    for (auto it = this->begin(); it != end; ++it) {
-        if (it->first == key) return it;
-    }
-    return end;
+bool Json::object::operator==(const Json::object& other) const {
+    if (m_data.size() != other.m_data.size())
+        return false;
+    if (m_data == other.m_data)
+        return true;
+    const auto a = sorted_members(*this), b = sorted_members(other);
+    return std::equal(a.begin(), a.end(), b.begin(), [](const auto *x, const auto *y) {
+        return *x == *y;
+    });
 }
 
-Json::object::const_iterator Json::object::find(const std::string& key) const {
-    auto end = this->cend();
-    for (auto it = this->cbegin(); it != end; ++it) {
-        if (it->first == key) return it;
-    }
-    return end;
+bool Json::object::operator<(const Json::object& other) const {
+    const auto a = sorted_members(*this), b = sorted_members(other);
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+                                        [](const auto *x, const auto *y) { return *x < *y; });
+}
+
+Json::object::iterator Json::object::find(std::string_view key) {
+    return m_data.begin() + position(key);
+}
+
+Json::object::const_iterator Json::object::find(std::string_view key) const {
+    return m_data.cbegin() + position(key);
 }
 
 std::pair<Json::object::iterator, bool> Json::object::insert(const Json::object::value_type& value) {
@@ -858,19 +3278,23 @@ std::pair<Json::object::iterator, bool> Json::object::insert(const Json::object:
         return {it, false};
     } else {
         m_data.push_back(value);
+        if (Index *index = m_index.load(std::memory_order_relaxed))
+            index->add(m_data, m_data.size() - 1);
         return {--m_data.end(), true};
     }
 }
 
-size_t Json::object::count(const std::string& key) const {
+size_t Json::object::count(std::string_view key) const {
     return this->find(key) == this->end() ? 0 : 1;
 }
 
-Json& Json::object::operator[](const std::string& key) {
+Json& Json::object::operator[](std::string_view key) {
     if (auto it = this->find(key); it != this->end()) {
         return it->second;
     } else {
-        m_data.push_back({key, Json()});
+        m_data.emplace_back(string(key), Json());
+        if (Index *index = m_index.load(std::memory_order_relaxed))
+            index->add(m_data, m_data.size() - 1);
         return m_data.back().second;
     }
 }
@@ -32,15 +32,20 @@
 #include <cassert>
 #include <string>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <sstream>
 #include <json11.hpp>
+#include <limits>
 #include <list>
 #include <set>
 #include <unordered_map>
 #include <algorithm>
 #include <type_traits>
+#include <memory_resource>
+#include <atomic>
+#include <thread>
 
 // Insert user-defined prefix code (includes, function declarations, etc)
 // to set up a custom test suite
@@ -58,6 +63,7 @@ CHECK_TRAIT(is_nothrow_move_constructible<Json>);
 CHECK_TRAIT(is_copy_assignable<Json>);
 CHECK_TRAIT(is_nothrow_move_assignable<Json>);
 CHECK_TRAIT(is_nothrow_destructible<Json>);
+static_assert(sizeof(Json) <= 2 * sizeof(double), "scalars should be stored inline");
 
 JSON11_TEST_CASE(json11_test) {
     const string simple_test =
@@ -299,6 +305,1090 @@ JSON11_TEST_CASE(json11_test_geode) {
   }
 }
 
+JSON11_TEST_CASE(json11_test_value_semantics) {
+    Json a = Json::array { "x", 1, true };
+    Json b = a;
+    JSON11_TEST_ASSERT(a == b);
+
+    Json c = std::move(b);
+    JSON11_TEST_ASSERT(b.is_null());
+    JSON11_TEST_ASSERT(c == a);
+
+    b = c;
+    c = Json("replaced");
+    JSON11_TEST_ASSERT(b == a);
+    JSON11_TEST_ASSERT(c.string_value() == "replaced");
+
+    b = b;
+    JSON11_TEST_ASSERT(b == a);
+
+    Json d = 5;
+    d = std::move(b);
+    JSON11_TEST_ASSERT(b.is_null());
+    JSON11_TEST_ASSERT(d == a);
+    b = std::move(d);
+    JSON11_TEST_ASSERT(d.is_null());
+
+    Json obj = Json::object { { "k", Json::array { 1, 2, 3 } } };
+    JSON11_TEST_ASSERT(obj.get<Json::array>("k").size() == 3);
+}
+
+JSON11_TEST_CASE(json11_test_document) {
+    const string input = R"({"k1": "v1", "k2": [1, 2.5, "a string long enough to leave SSO"], "k3": {}})";
+    string err;
+    const Json expected = Json::parse(input, err);
+
+    JsonDocument doc;
+    for (int i = 0; i < 3; i++) {
+        const Json &root = doc.parse(input, err);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(root == expected);
+        JSON11_TEST_ASSERT(&root == &doc.root());
+    }
+
+    JSON11_TEST_ASSERT(doc.parse("[1, 2", err).is_null());
+    JSON11_TEST_ASSERT(!err.empty());
+
+    doc.clear();
+    JSON11_TEST_ASSERT(doc.root().is_null());
+}
+
+JSON11_TEST_CASE(json11_test_memory_resource) {
+    const string input = R"({"list": [1, 2, 3], "nested": {"k": [true]}})";
+    string err;
+
+    std::pmr::monotonic_buffer_resource resource;
+    const Json json = Json::parse(input, err, JsonParse::STANDARD, &resource);
+    JSON11_TEST_ASSERT(err.empty());
+    JSON11_TEST_ASSERT(json == Json::parse(input, err));
+    JSON11_TEST_ASSERT(json.object_items().get_allocator().resource() == &resource);
+    JSON11_TEST_ASSERT(json["list"].array_items().get_allocator().resource() == &resource);
+    JSON11_TEST_ASSERT(json["nested"]["k"].array_items().get_allocator().resource() == &resource);
+
+    Json::array items(&resource);
+    items.push_back("x");
+    const Json array(std::move(items), &resource);
+    JSON11_TEST_ASSERT(array.array_items().get_allocator().resource() == &resource);
+    JSON11_TEST_ASSERT(array.dump() == "[\"x\"]");
+}
+
+JSON11_TEST_CASE(json11_test_object_parsing) {
+    string err;
+    const Json ordered = Json::parse(R"({"b": 1, "a": 2, "c": 3})", err);
+    JSON11_TEST_ASSERT(ordered.dump() == R"({"b": 1, "a": 2, "c": 3})");
+
+    const string duplicates = R"({"a": 1, "b": 2, "a": 3, "c": 4, "b": 5})";
+    JsonParseOptions options;
+    options.duplicate_keys = KEEP_LAST;
+    JSON11_TEST_ASSERT(Json::parse(duplicates, err, options).dump() == R"({"a": 3, "b": 5, "c": 4})");
+    options.duplicate_keys = KEEP_FIRST;
+    JSON11_TEST_ASSERT(Json::parse(duplicates, err, options).dump() == R"({"a": 1, "b": 2, "c": 4})");
+    options.duplicate_keys = REJECT_DUPLICATES;
+    JSON11_TEST_ASSERT(Json::parse(duplicates, err, options).is_null());
+    JSON11_TEST_ASSERT(err == R"(duplicate key "a" in object)");
+
+    // Objects compare by their members, whatever order the keys came in.
+    const Json ab = Json::parse(R"({"a": 1, "b": {"x": 1, "y": 2}})", err);
+    const Json ba = Json::parse(R"({"b": {"y": 2, "x": 1}, "a": 1})", err);
+    const Json ba_other = Json::parse(R"({"b": {"y": 3, "x": 1}, "a": 1})", err);
+    JSON11_TEST_ASSERT(ab == ba && !(ab < ba) && !(ba < ab));
+    JSON11_TEST_ASSERT(ab != ba_other && ab < ba_other && !(ba_other < ab));
+    JSON11_TEST_ASSERT(Json::parse(R"({"a": 2})", err) < Json::parse(R"({"b": 1, "a": 3})", err));
+
+    // Wide objects take the sorting path.
+    string wide = "{";
+    for (int i = 0; i < 100; i++)
+        wide += "\"k" + std::to_string(i) + "\": " + std::to_string(i) + ", ";
+    wide += R"("k7": "last", "k0": "again"})";
+    err.clear();
+    const Json wide_json = Json::parse(wide, err);
+    JSON11_TEST_ASSERT(err.empty());
+    JSON11_TEST_ASSERT(wide_json.object_items().size() == 100);
+    JSON11_TEST_ASSERT(wide_json.object_items().begin()->first == "k0");
+    JSON11_TEST_ASSERT(wide_json["k0"].string_value() == "again");
+    JSON11_TEST_ASSERT(wide_json["k7"].string_value() == "last");
+    JSON11_TEST_ASSERT(wide_json["k99"].int_value() == 99);
+}
+
+JSON11_TEST_CASE(json11_test_object_index) {
+    Json::object obj;
+    for (int i = 0; i < 100; i++) {
+        obj["key" + std::to_string(i)] = i;
+        JSON11_TEST_ASSERT(obj.count("key" + std::to_string(i / 2)) == 1);
+    }
+    JSON11_TEST_ASSERT(obj.size() == 100);
+    for (int i = 0; i < 100; i++)
+        JSON11_TEST_ASSERT(obj.find("key" + std::to_string(i))->second.int_value() == i);
+    JSON11_TEST_ASSERT(obj.find("missing") == obj.end());
+
+    JSON11_TEST_ASSERT(!obj.insert({ "key5", "ignored" }).second);
+    JSON11_TEST_ASSERT(obj.insert({ "extra", "added" }).second);
+    JSON11_TEST_ASSERT(obj["extra"].string_value() == "added");
+    JSON11_TEST_ASSERT(obj.begin()->first == "key0");
+
+    Json::object copy = obj;
+    copy["only_in_copy"] = true;
+    JSON11_TEST_ASSERT(copy.count("only_in_copy") == 1);
+    JSON11_TEST_ASSERT(obj.count("only_in_copy") == 0);
+
+    Json::object moved = std::move(copy);
+    JSON11_TEST_ASSERT(moved.count("only_in_copy") == 1);
+    obj = moved;
+    JSON11_TEST_ASSERT(obj.count("only_in_copy") == 1);
+
+    // A repeated key resolves to its first occurrence, as with a linear search.
+    std::vector<std::pair<string, Json>> members;
+    for (int i = 0; i < 40; i++)
+        members.emplace_back("k" + std::to_string(i % 20), i);
+    const Json::object repeated(members.begin(), members.end());
+    JSON11_TEST_ASSERT(repeated.find("k3")->second.int_value() == 3);
+
+    // Const lookups from several threads may build the index of an object in a document's
+    // arena at the same time. The object is large enough for the builds to overlap.
+    string wide = "{";
+    for (int i = 0; i < 5000; i++)
+        wide += (i ? ", \"key" : "\"key") + std::to_string(i) + "\": " + std::to_string(i);
+    wide += "}";
+    for (int round = 0; round < 20; round++) {
+        JsonDocument document;
+        string err;
+        const Json &json = document.parse(wide, err);
+        std::vector<std::thread> threads;
+        std::atomic<int> found { 0 };
+        std::atomic<bool> start { false };
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&] {
+                while (!start)
+                    std::this_thread::yield();
+                for (int i = 0; i < 5000; i += 50)
+                    found += json["key" + std::to_string(i)].int_value() == i;
+            });
+        }
+        start = true;
+        for (auto &thread : threads)
+            thread.join();
+        JSON11_TEST_ASSERT(found == 400);
+    }
+}
+
+JSON11_TEST_CASE(json11_test_string_view_lookup) {
+    Json json = Json::object { { "a_key_longer_than_the_sso_buffer", 1 }, { "b", "text" } };
+    const std::string_view view = "a_key_longer_than_the_sso_buffer";
+    const char *ptr = "b";
+    const string str = "b";
+
+    JSON11_TEST_ASSERT(json[view].int_value() == 1);
+    JSON11_TEST_ASSERT(json[ptr].string_value() == "text");
+    JSON11_TEST_ASSERT(json[str].string_value() == "text");
+    JSON11_TEST_ASSERT(json.get<int>(view) == 1);
+    JSON11_TEST_ASSERT(json.get<string>(std::string_view("b")) == "text");
+    JSON11_TEST_ASSERT(json.object_items().count(view) == 1);
+    JSON11_TEST_ASSERT(json.object_items().find(std::string_view("missing")) == json.object_items().end());
+
+    json[std::string_view("c")] = true;
+    JSON11_TEST_ASSERT(json["c"].bool_value());
+    JSON11_TEST_ASSERT(Json(Json::array({ 10, 20 }))[0].int_value() == 10);
+}
+
+JSON11_TEST_CASE(json11_test_unterminated_input) {
+    // Each input is copied into a buffer of exactly its size, so reading past the end is a
+    // heap overflow that sanitizers catch.
+    const string inputs[] = {
+        "123", "-12.5e3", "tru", "nul", "[1", "[1, 2]", "{\"a\": 1}", "\"abc", "\"abc\"",
+        "\"\\u12", "\"\\u1234\"", "\"\\", "-", "1.", "1e", "1e+", "0", "{\"a\"", "[1 // c",
+        "[1 /* c", "/", "  ",
+    };
+    for (const auto &input : inputs) {
+        for (JsonParse strategy : { JsonParse::STANDARD, JsonParse::COMMENTS }) {
+            std::unique_ptr<char[]> buffer(new char[input.size()]);
+            std::memcpy(buffer.get(), input.data(), input.size());
+
+            string err, expected_err;
+            const Json json = Json::parse(buffer.get(), input.size(), err, strategy);
+            const Json expected = Json::parse(string(input), expected_err, strategy);
+            JSON11_TEST_ASSERT(json == expected);
+            JSON11_TEST_ASSERT(err == expected_err);
+
+            string::size_type stop_pos;
+            Json::parse_multi(std::string_view(buffer.get(), input.size()), stop_pos, err, strategy);
+        }
+    }
+
+    string err;
+    const char numbers[] = { '4', '2', '7' };
+    JSON11_TEST_ASSERT(Json::parse(numbers, 2, err).int_value() == 42);
+}
+
+JSON11_TEST_CASE(json11_test_whitespace) {
+    // Runs of every length around the vector widths, ending on every kind of whitespace.
+    const char ws[] = { ' ', '\n', '\r', '\t' };
+    for (size_t len = 0; len < 70; len++) {
+        string pad;
+        for (size_t k = 0; k < len; k++)
+            pad += ws[(k * 7 + len) % 4];
+
+        const string input = pad + "[" + pad + "1" + pad + "," + pad + "{" + pad + "\"k\"" + pad
+                           + ":" + pad + "true" + pad + "}" + pad + "]" + pad;
+        string err;
+        const Json json = Json::parse(input, err);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(json.dump() == R"([1, {"k": true}])");
+
+        JSON11_TEST_ASSERT(Json::parse(input + "x", err).is_null());
+        JSON11_TEST_ASSERT(err == "unexpected trailing 'x' (120)");
+    }
+}
+
+JSON11_TEST_CASE(json11_test_string_scanning) {
+    // Special characters at every offset around the vector widths.
+    for (size_t len = 0; len < 70; len++) {
+        string text;
+        for (size_t k = 0; k < len; k++)
+            text += static_cast<char>('a' + k % 26);
+        string err;
+
+        Json json = Json::parse("\"" + text + "\"", err);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(json.string_value() == text);
+
+        json = Json::parse("\"" + text + "\\n\\u00e9" + text + "\\\"\"", err);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(json.string_value() == text + "\n\xc3\xa9" + text + "\"");
+
+        json = Json::parse("\"" + text + "\xc3\xa9\x7f\"", err);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(json.string_value() == text + "\xc3\xa9\x7f");
+
+        JSON11_TEST_ASSERT(Json::parse("\"" + text + "\x01\"", err).is_null());
+        JSON11_TEST_ASSERT(err == "unescaped (1) in string");
+
+        JSON11_TEST_ASSERT(Json::parse("\"" + text, err).is_null());
+        JSON11_TEST_ASSERT(err == "unexpected end of input in string");
+    }
+}
+
+JSON11_TEST_CASE(json11_test_number_parsing) {
+    const char * numbers[] = {
+        "0", "-0", "7", "-7", "123456789", "-123456789", "1234567890", "-2147483648",
+        "0.1", "-0.5", "3.141592653589793", "1e3", "1E-3", "2.5e+10", "-1.7976931348623157e308",
+        "2.2250738585072014e-308", "4.9e-324", "123456789012345678901234567890", "1e400", "-1e400",
+        "1e-400", "0.30000000000000004", "9007199254740993",
+    };
+    for (const char * number : numbers) {
+        string err;
+        const Json json = Json::parse(number, err);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(json.number_value() == std::strtod(number, nullptr));
+        if (json.is_number() && std::strlen(number) <= 9 && !std::strpbrk(number, ".eE"))
+            JSON11_TEST_ASSERT(json.int_value() == std::atoi(number));
+    }
+
+    string err;
+    const Json expected = Json::array { 1.5, -2, 300.0 };
+    JSON11_TEST_ASSERT(Json::parse("[1.5,-2,3e2]", err) == expected);
+    JSON11_TEST_ASSERT(Json::parse("01", err).is_null());
+    JSON11_TEST_ASSERT(err == "leading 0s not permitted in numbers");
+    JSON11_TEST_ASSERT(Json::parse("1.", err).is_null());
+    JSON11_TEST_ASSERT(err == "at least one digit required in fractional part");
+    JSON11_TEST_ASSERT(Json::parse("1e+", err).is_null());
+    JSON11_TEST_ASSERT(err == "at least one digit required in exponent");
+}
+
+JSON11_TEST_CASE(json11_test_64bit_integers) {
+    string err;
+    const Json id = Json::parse("1234567890123456789", err);
+    JSON11_TEST_ASSERT(err.empty());
+    JSON11_TEST_ASSERT(id.is_number());
+    JSON11_TEST_ASSERT(id.int64_value() == 1234567890123456789LL);
+    JSON11_TEST_ASSERT(id.dump() == "1234567890123456789");
+
+    const Json timestamps = Json::parse(
+        "[-9223372036854775808, 9223372036854775807, 18446744073709551615, -2147483649]", err);
+    JSON11_TEST_ASSERT(err.empty());
+    JSON11_TEST_ASSERT(timestamps[0].int64_value() == std::numeric_limits<int64_t>::min());
+    JSON11_TEST_ASSERT(timestamps[1].int64_value() == std::numeric_limits<int64_t>::max());
+    JSON11_TEST_ASSERT(timestamps[2].uint64_value() == std::numeric_limits<uint64_t>::max());
+    JSON11_TEST_ASSERT(timestamps[3].int64_value() == -2147483649LL);
+    JSON11_TEST_ASSERT(timestamps.dump()
+        == "[-9223372036854775808, 9223372036854775807, 18446744073709551615, -2147483649]");
+
+    // Out of 64-bit range: falls back to double.
+    JSON11_TEST_ASSERT(Json::parse("18446744073709551616", err).number_value() == 18446744073709551616.0);
+    JSON11_TEST_ASSERT(Json::parse("-9223372036854775809", err).number_value() == -9223372036854775809.0);
+
+    // Integral constructors keep the exact value.
+    const int64_t big = 9007199254740993LL;
+    JSON11_TEST_ASSERT(Json(big).int64_value() == big);
+    JSON11_TEST_ASSERT(Json(static_cast<long long>(big)).as<long long>() == big);
+    JSON11_TEST_ASSERT(Json(std::numeric_limits<uint64_t>::max()).as<uint64_t>()
+                       == std::numeric_limits<uint64_t>::max());
+    JSON11_TEST_ASSERT(Json(static_cast<short>(-3)).int_value() == -3);
+
+    // Integers compare exactly, and with doubles by value.
+    JSON11_TEST_ASSERT(Json(big) != Json(big + 1));
+    JSON11_TEST_ASSERT(Json(big) < Json(big + 1));
+    JSON11_TEST_ASSERT(Json(std::numeric_limits<uint64_t>::max()) > Json(int64_t(-1)));
+    JSON11_TEST_ASSERT(Json(int64_t(5)) == Json(5));
+    JSON11_TEST_ASSERT(Json(uint64_t(5)) == Json(5.0));
+    JSON11_TEST_ASSERT(Json(int64_t(-5)) < Json(uint64_t(5)));
+
+    // Values outside the accessor's range clamp to its limits, and NaN converts to 0.
+    const Json huge = Json(1e300);
+    const Json tiny = Json(-1e300);
+    const Json nan = Json(std::numeric_limits<double>::quiet_NaN());
+    JSON11_TEST_ASSERT(huge.int_value() == std::numeric_limits<int>::max());
+    JSON11_TEST_ASSERT(huge.int64_value() == std::numeric_limits<int64_t>::max());
+    JSON11_TEST_ASSERT(huge.uint64_value() == std::numeric_limits<uint64_t>::max());
+    JSON11_TEST_ASSERT(tiny.int_value() == std::numeric_limits<int>::min());
+    JSON11_TEST_ASSERT(tiny.int64_value() == std::numeric_limits<int64_t>::min());
+    JSON11_TEST_ASSERT(tiny.uint64_value() == 0);
+    JSON11_TEST_ASSERT(nan.int_value() == 0 && nan.int64_value() == 0 && nan.uint64_value() == 0);
+    JSON11_TEST_ASSERT(Json(9223372036854775808.0).int64_value() == std::numeric_limits<int64_t>::max());
+    JSON11_TEST_ASSERT(Json(18446744073709551616.0).uint64_value() == std::numeric_limits<uint64_t>::max());
+    JSON11_TEST_ASSERT(Json(-1.5).uint64_value() == 0);
+    JSON11_TEST_ASSERT(Json(-2.5).int64_value() == -2);
+    JSON11_TEST_ASSERT(Json(std::numeric_limits<uint64_t>::max()).int64_value()
+                       == std::numeric_limits<int64_t>::max());
+    JSON11_TEST_ASSERT(Json(std::numeric_limits<uint64_t>::max()).int_value()
+                       == std::numeric_limits<int>::max());
+    JSON11_TEST_ASSERT(Json(int64_t(-3000000000LL)).int_value() == std::numeric_limits<int>::min());
+    JSON11_TEST_ASSERT(Json(int64_t(-1)).uint64_value() == 0);
+    JSON11_TEST_ASSERT(Json(-1).uint64_value() == 0);
+
+    // The lazy accessors read untrusted text, so they clamp the same way.
+    JsonLazyDocument doc;
+    JSON11_TEST_ASSERT(doc.parse("[1e300, -1e300, -1, 1e19]", err));
+    JSON11_TEST_ASSERT(doc.root()[0].int_value() == std::numeric_limits<int>::max());
+    JSON11_TEST_ASSERT(doc.root()[1].int64_value() == std::numeric_limits<int64_t>::min());
+    JSON11_TEST_ASSERT(doc.root()[2].uint64_value() == 0);
+    JSON11_TEST_ASSERT(doc.root()[3].int64_value() == std::numeric_limits<int64_t>::max());
+}
+
+JSON11_TEST_CASE(json11_test_double_dump) {
+    JSON11_TEST_ASSERT(Json(0.1).dump() == "0.1");
+    JSON11_TEST_ASSERT(Json(-2.5).dump() == "-2.5");
+    JSON11_TEST_ASSERT(Json(100.0).dump() == "100");
+    JSON11_TEST_ASSERT(Json(1e300 * 1e300).dump() == "null");
+
+    // The shortest output still parses back to exactly the same double.
+    const double values[] = {
+        0.1 + 0.2, 1.0 / 3, 5e-324, 2.2250738585072014e-308, 1.7976931348623157e308,
+        -0.0, 123456.789e-20, 9007199254740993.0, 1e21, 6.02214076e23,
+    };
+    for (double value : values) {
+        string err;
+        const Json json = Json::parse(Json(value).dump(), err);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(json.number_value() == value);
+    }
+}
+
+JSON11_TEST_CASE(json11_test_writer) {
+    const Json json = Json::array {
+        0, -1, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(),
+        std::numeric_limits<int64_t>::min(), std::numeric_limits<uint64_t>::max(),
+        true, false, nullptr, "a\tb\x01", Json::object { { "k", Json::array {} } },
+    };
+    const string expected = "[0, -1, -2147483648, 2147483647, -9223372036854775808, "
+                            "18446744073709551615, true, false, null, \"a\\tb\\u0001\", "
+                            "{\"k\": []}]";
+    JSON11_TEST_ASSERT(json.dump() == expected);
+
+    // Dumping appends to what is already in the string, however large the output grows.
+    string out = "prefix ";
+    json.dump(out);
+    JSON11_TEST_ASSERT(out == "prefix " + expected);
+
+    Json::array many(10000, Json(-123456789));
+    string big = "x";
+    Json(many).dump(big);
+    JSON11_TEST_ASSERT(big.size() == 1 + 2 + 10000 * 10 + 9999 * 2);
+    JSON11_TEST_ASSERT(big.compare(0, 14, "x[-123456789, ") == 0);
+}
+
+JSON11_TEST_CASE(json11_test_string_escaping) {
+    // Characters that need escaping at every offset around the vector widths.
+    for (size_t len = 0; len < 70; len++) {
+        string text;
+        for (size_t k = 0; k < len; k++)
+            text += static_cast<char>('a' + k % 26);
+
+        JSON11_TEST_ASSERT(Json(text).dump() == "\"" + text + "\"");
+        JSON11_TEST_ASSERT(Json(text + "\"\\/\b\f\n\r\t" + text).dump()
+                           == "\"" + text + "\\\"\\\\/\\b\\f\\n\\r\\t" + text + "\"");
+        JSON11_TEST_ASSERT(Json(text + string("\x00\x01\x1f", 3)).dump()
+                           == "\"" + text + "\\u0000\\u0001\\u001f\"");
+        JSON11_TEST_ASSERT(Json(text + "\xe2\x80\xa8\xe2\x80\xa9" + text).dump()
+                           == "\"" + text + "\\u2028\\u2029" + text + "\"");
+        // Other characters starting with 0xE2, and a truncated sequence, are left alone.
+        JSON11_TEST_ASSERT(Json(text + "\xe2\x82\xac\x7f\xe2\x80").dump()
+                           == "\"" + text + "\xe2\x82\xac\x7f\xe2\x80\"");
+    }
+}
+
+JSON11_TEST_CASE(json11_test_dump_options) {
+    const Json json = Json::object {
+        { "name", "x" },
+        { "tags", Json::array { 1, "two", Json::array {} } },
+        { "meta", Json::object {} },
+        { "nested", Json::object { { "k", nullptr } } },
+    };
+    JSON11_TEST_ASSERT(json.dump()
+        == R"({"name": "x", "tags": [1, "two", []], "meta": {}, "nested": {"k": null}})");
+    JSON11_TEST_ASSERT(json.dump(COMPACT)
+        == R"({"name":"x","tags":[1,"two",[]],"meta":{},"nested":{"k":null}})");
+    JSON11_TEST_ASSERT(json.dump(PRETTY) == R"({
+    "name": "x",
+    "tags": [
+        1,
+        "two",
+        []
+    ],
+    "meta": {},
+    "nested": {
+        "k": null
+    }
+})");
+    JSON11_TEST_ASSERT(json["tags"].dump({ PRETTY, 2 }) == "[\n  1,\n  \"two\",\n  []\n]");
+    JSON11_TEST_ASSERT(Json(Json::array { 1, 2 }).dump({ PRETTY, 0 }) == "[\n1,\n2\n]");
+    JSON11_TEST_ASSERT(Json(7).dump(PRETTY) == "7");
+
+    // Every format parses back to the same value.
+    for (JsonFormat format : { SPACED, COMPACT, PRETTY }) {
+        string err;
+        JSON11_TEST_ASSERT(Json::parse(json.dump(format), err) == json);
+        JSON11_TEST_ASSERT(err.empty());
+    }
+}
+
+JSON11_TEST_CASE(json11_test_dump_sinks) {
+    Json::array records;
+    for (int i = 0; i < 5000; i++)
+        records.push_back(Json::object { { "id", i }, { "text", string(i % 50, 'x') } });
+    const Json json = records;
+    const string expected = json.dump(COMPACT);
+    JSON11_TEST_ASSERT(expected.size() > 200000);
+
+    // The output arrives in order, in bounded pieces.
+    string streamed;
+    size_t pieces = 0, largest = 0;
+    json.dump([&](const char *data, size_t size) {
+        streamed.append(data, size);
+        pieces++;
+        largest = std::max(largest, size);
+    }, COMPACT);
+    JSON11_TEST_ASSERT(streamed == expected);
+    JSON11_TEST_ASSERT(pieces > 1);
+    JSON11_TEST_ASSERT(largest <= 64 * 1024);
+
+    std::ostringstream stream;
+    json.dump(stream, COMPACT);
+    JSON11_TEST_ASSERT(stream.str() == expected);
+
+    for (bool use_fd : { false, true }) {
+        std::FILE *file = std::tmpfile();
+        JSON11_TEST_ASSERT(file);
+        if (use_fd)
+            json.dump_fd(fileno(file), COMPACT);
+        else
+            json.dump(file, COMPACT);
+        std::fflush(file);
+        std::rewind(file);
+        string contents(expected.size() + 1, '\0');
+        contents.resize(std::fread(&contents[0], 1, contents.size(), file));
+        std::fclose(file);
+        JSON11_TEST_ASSERT(contents == expected);
+    }
+
+    // An indentation wider than the buffer still comes out whole.
+    const Json wide = Json::array { 1 };
+    string indented;
+    wide.dump([&](const char *data, size_t size) { indented.append(data, size); }, { PRETTY, 100000 });
+    JSON11_TEST_ASSERT(indented == wide.dump({ PRETTY, 100000 }));
+
+    // A sink may stop the dump by throwing.
+    bool thrown = false;
+    try {
+        json.dump([](const char *, size_t) { throw JsonException("full"); });
+    } catch (const JsonException &) {
+        thrown = true;
+    }
+    JSON11_TEST_ASSERT(thrown);
+}
+
+JSON11_TEST_CASE(json11_test_dump_size) {
+    const Json json = Json::object {
+        { "id", 1234567890123LL },
+        { "ratio", 0.1 },
+        { "text", "tab\there \xe2\x80\xa8 \x01" },
+        { "list", Json::array { nullptr, true, Json::object {} } },
+    };
+    for (JsonDumpOptions options : { JsonDumpOptions(SPACED), JsonDumpOptions(COMPACT),
+                                     JsonDumpOptions(PRETTY, 2), JsonDumpOptions(PRETTY, 5000) }) {
+        const string expected = json.dump(options);
+        JSON11_TEST_ASSERT(json.dump_size(options) == expected.size());
+
+        // Exactly enough room.
+        string buffer(expected.size(), '\0');
+        JSON11_TEST_ASSERT(json.dump(&buffer[0], buffer.size(), options) == expected.size());
+        JSON11_TEST_ASSERT(buffer == expected);
+
+        // Not enough room: the result still reports the full length.
+        char small[16];
+        JSON11_TEST_ASSERT(json.dump(small, sizeof small, options) == expected.size());
+        JSON11_TEST_ASSERT(string(small, sizeof small) == expected.substr(0, sizeof small));
+    }
+
+    // Dumping into a string appends however much capacity it starts with.
+    for (size_t capacity : { 0, 20, 60, 1000 }) {
+        string out = "prefix ";
+        out.reserve(capacity);
+        json.dump(out);
+        JSON11_TEST_ASSERT(out == "prefix " + json.dump());
+    }
+
+    char buffer[8];
+    JSON11_TEST_ASSERT(Json(42).dump(buffer, sizeof buffer) == 2);
+    JSON11_TEST_ASSERT(string(buffer, 2) == "42");
+    JSON11_TEST_ASSERT(Json("x").dump(nullptr, 0) == 3);
+}
+
+// Records every event as a line of text.
+struct EventLog final : JsonHandler {
+    string log;
+    string stop_at;
+
+    bool event(const string &line) {
+        log += line + "\n";
+        return line != stop_at;
+    }
+    bool on_null() override { return event("null"); }
+    bool on_bool(bool value) override { return event(value ? "true" : "false"); }
+    bool on_number(const Json &value) override { return event("number " + value.dump()); }
+    bool on_string(std::string_view value) override { return event("string " + string(value)); }
+    bool on_key(std::string_view key) override { return event("key " + string(key)); }
+    bool start_array() override { return event("["); }
+    bool end_array() override { return event("]"); }
+    bool start_object() override { return event("{"); }
+    bool end_object() override { return event("}"); }
+};
+
+JSON11_TEST_CASE(json11_test_event_parsing) {
+    const string input = R"({"id": 12345678901, "tags": ["a\nb", true, null, []],
+                             "nested": {"x": -1.5, "x": {}}, "plain": "text"})";
+    EventLog events;
+    string err;
+    JSON11_TEST_ASSERT(Json::parse(input, events, err));
+    JSON11_TEST_ASSERT(err.empty());
+    JSON11_TEST_ASSERT(events.log ==
+        "{\nkey id\nnumber 12345678901\nkey tags\n[\nstring a\nb\ntrue\nnull\n[\n]\n]\n"
+        "key nested\n{\nkey x\nnumber -1.5\nkey x\n{\n}\n}\nkey plain\nstring text\n}\n");
+
+    // A handler may stop the parse at any event.
+    EventLog stopping;
+    stopping.stop_at = "key tags";
+    JSON11_TEST_ASSERT(!Json::parse(input, stopping, err));
+    JSON11_TEST_ASSERT(err == "parse stopped by handler");
+    JSON11_TEST_ASSERT(stopping.log == "{\nkey id\nnumber 12345678901\nkey tags\n");
+
+    // Syntax errors are reported as by the value parser, after the events that preceded them.
+    EventLog broken;
+    JSON11_TEST_ASSERT(!Json::parse("[1, 2", broken, err));
+    JSON11_TEST_ASSERT(err == "unexpected end of input");
+    JSON11_TEST_ASSERT(broken.log == "[\nnumber 1\nnumber 2\n");
+    JSON11_TEST_ASSERT(!Json::parse("[1] x", broken, err));
+    JSON11_TEST_ASSERT(err == "unexpected trailing 'x' (120)");
+
+    // The default handler accepts everything, and comments follow the parse options.
+    JsonHandler ignore;
+    JSON11_TEST_ASSERT(Json::parse("/* c */ [1, {\"k\": \"v\"}] // c", ignore, err, COMMENTS));
+    JSON11_TEST_ASSERT(!Json::parse("/* c */ 1", ignore, err));
+
+    // Only values built from events apply the duplicate key policy.
+    JsonParseOptions reject;
+    reject.duplicate_keys = REJECT_DUPLICATES;
+    JSON11_TEST_ASSERT(Json::parse(input, ignore, err, reject));
+    JSON11_TEST_ASSERT(Json::parse(input, err, reject).is_null());
+    JSON11_TEST_ASSERT(err == "duplicate key \"x\" in object");
+}
+
+// Feed input to a stream parser in chunks of the given size and collect the values.
+static std::vector<Json> parse_chunked(const string &input, size_t chunk, string &err,
+                                  const JsonParseOptions &options = {}) {
+    JsonStreamParser parser(options);
+    std::vector<Json> values;
+    Json value;
+    for (size_t pos = 0; pos < input.size(); pos += chunk) {
+        parser.feed(std::string_view(input).substr(pos, chunk));
+        while (parser.next(value))
+            values.push_back(value);
+    }
+    parser.finish();
+    while (parser.next(value))
+        values.push_back(value);
+    err = parser.error();
+    return values;
+}
+
+JSON11_TEST_CASE(json11_test_stream_parsing) {
+    const string input = R"( {"k": "a\"b\\", "n": [1, -2.5e3, {}, [[]]], "u": "\u00e9"}
+        12345 "x]}" true null [] -0.125 "\ud83d\ude00" {"deep": [{"a": [1, {"b": "}"}]}]} 7)";
+    string err;
+    const std::vector<Json> expected = Json::parse_multi(input, err);
+    JSON11_TEST_ASSERT(err.empty());
+    JSON11_TEST_ASSERT(expected.size() == 10);
+
+    // Any split of the input gives the same values.
+    for (size_t chunk = 1; chunk <= input.size(); chunk++) {
+        JSON11_TEST_ASSERT(parse_chunked(input, chunk, err) == expected);
+        JSON11_TEST_ASSERT(err.empty());
+    }
+
+    // Values are ready as soon as they end; a top-level number waits for what follows it.
+    JsonStreamParser parser;
+    Json value;
+    JSON11_TEST_ASSERT(parser.feed("[1, 2"));
+    JSON11_TEST_ASSERT(!parser.next(value));
+    JSON11_TEST_ASSERT(parser.feed("] 4"));
+    JSON11_TEST_ASSERT(parser.next(value) && value == Json(Json::array { 1, 2 }));
+    JSON11_TEST_ASSERT(!parser.next(value));
+    JSON11_TEST_ASSERT(parser.feed("2 "));
+    JSON11_TEST_ASSERT(parser.next(value) && value == Json(42));
+    JSON11_TEST_ASSERT(parser.finish());
+
+    // Comments, when enabled, may be split too.
+    const string commented = "/* a [ */ [1, // ] \n 2] // end";
+    for (size_t chunk = 1; chunk <= commented.size(); chunk++) {
+        const std::vector<Json> values = parse_chunked(commented, chunk, err, COMMENTS);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(values.size() == 1 && values[0] == Json(Json::array { 1, 2 }));
+    }
+
+    // Errors carry the parser's messages; values before them are still delivered.
+    const struct {
+        const char * input;
+        size_t values;
+        const char * error;
+    } errors[] = {
+        { "[1, 2", 0, "unexpected end of input" },
+        { "1 \"abc", 1, "unexpected end of input in string" },
+        { "{} [1, ] 3", 1, "expected value, got ']' (93)" },
+        { "[1] ]", 1, "expected value, got ']' (93)" },
+        { "tru", 0, "parse error: expected true, got tru" },
+        { "12x", 1, "expected value, got 'x' (120)" },
+        { "01", 0, "leading 0s not permitted in numbers" },
+        { "1 -x", 1, "invalid 'x' (120) in number" },
+        { "1.e5", 0, "at least one digit required in fractional part" },
+        { "2e+", 0, "at least one digit required in exponent" },
+        { "true trux", 1, "parse error: expected true, got trux" },
+        { "/* c */ 1", 0, "expected value, got '/' (47)" },
+    };
+    for (const auto &error : errors) {
+        for (size_t chunk : { 1, 2, 100 }) {
+            const std::vector<Json> values = parse_chunked(error.input, chunk, err);
+            JSON11_TEST_ASSERT(values.size() == error.values);
+            JSON11_TEST_ASSERT(err == error.error);
+        }
+    }
+    // Top-level numbers and literals end where their grammar does, as in parse_multi.
+    const string scalars = "3-0 -1-3 truefalse 1.5e3null 0.25-7 12[3]";
+    err.clear();
+    const std::vector<Json> scalar_values = Json::parse_multi(scalars, err);
+    JSON11_TEST_ASSERT(err.empty() && scalar_values.size() == 12);
+    for (size_t chunk = 1; chunk <= scalars.size(); chunk++) {
+        JSON11_TEST_ASSERT(parse_chunked(scalars, chunk, err) == scalar_values);
+        JSON11_TEST_ASSERT(err.empty());
+    }
+
+    // Input without values is an empty sequence, where parse_multi reports an error.
+    for (const string blank : { "", "  \n ", "/* c */ // c" }) {
+        JSON11_TEST_ASSERT(parse_chunked(blank, 2, err, COMMENTS).empty() && err.empty());
+    }
+
+    parse_chunked("1 /* open", 3, err, COMMENTS);
+    JSON11_TEST_ASSERT(err == "unexpected end of input inside multi-line comment");
+}
+
+// Check that both parse engines give the same value and error for input.
+static void check_engines(const string &input, JsonDuplicateKeys duplicate_keys = KEEP_LAST) {
+    JsonParseOptions descent, indexed;
+    descent.duplicate_keys = indexed.duplicate_keys = duplicate_keys;
+    indexed.engine = STRUCTURAL_INDEX;
+
+    string descent_err, indexed_err;
+    const Json expected = Json::parse(input, descent_err, descent);
+    const Json json = Json::parse(input, indexed_err, indexed);
+    JSON11_TEST_ASSERT(json == expected);
+    JSON11_TEST_ASSERT(json.dump() == expected.dump());
+    JSON11_TEST_ASSERT(indexed_err == descent_err);
+}
+
+JSON11_TEST_CASE(json11_test_structural_index) {
+    const string inputs[] = {
+        R"({"k1":"v1", "k2":42, "k3":["a",123,true,false,null]})",
+        R"([ "blah\ud83d\udca9blah\ud83dblah\udca9blah\u0000blah\u1234" ])",
+        R"({"b": 1, "a": 2, "c": 3})", R"({"a": 1, "b": 2, "a": 3, "c": 4, "b": 5})",
+        "123", "-12.5e3", "tru", "nul", "[1", "[1, 2]", "{\"a\": 1}", "\"abc", "\"abc\"",
+        "\"\\u12", "\"\\u1234\"", "\"\\", "-", "1.", "1e", "1e+", "0", "{\"a\"", "[1 // c",
+        "[1 /* c", "/", "  ", "", "01", "[1.5,-2,3e2]", "1234567890123456789",
+        "18446744073709551616", "-9223372036854775809", "[]", "{}", "[[]]", "[{}]", "[1,]",
+        "{\"a\":}", "{,}", "[,1]", "[1 2]", "{\"a\" 1}", "{1: 2}", "truex", "[true]x", "1 2",
+        "\"a\"\"b\"", "[\"a\"x]", "[nullnull]", "[-]", "{\"a\":1,}", "\"\\\\\"", "\"\\\\\\\"\"",
+        "[\"\\\"]\", 1]", "\"\x01\"", "[1]\x7f", "{\"a\":[1,{\"b\":null}],\"c\":\"\\n\"}",
+    };
+    for (const auto &input : inputs) {
+        check_engines(input);
+        check_engines(input, REJECT_DUPLICATES);
+    }
+
+    // Strings, escapes and backslash runs ending at every offset around the 64-byte blocks.
+    for (size_t len = 0; len < 140; len++) {
+        const string text(len, 'a');
+        for (size_t slashes = 0; slashes < 4; slashes++) {
+            const string run(slashes, '\\');
+            check_engines("[\"" + text + run + "\", {\"" + text + "\": [" + text + "]}]");
+            check_engines("[\"" + text + run + "\"] ");
+            check_engines("{\"" + text + run + "\"" + run + ": 1}");
+        }
+        check_engines("[" + text + "]");
+        check_engines(string(len, ' ') + "[1," + string(len, '\n') + "2]");
+        check_engines("\"" + text + "\x01\"");
+    }
+
+    // Nesting at and beyond the depth limit.
+    for (size_t depth : { 199, 200, 201, 202 }) {
+        check_engines(string(depth, '[') + string(depth, ']'));
+        check_engines(string(depth, '['));
+    }
+
+    // Every single-character corruption of a document that covers the grammar.
+    const string document =
+        R"({"id": 12, "name": "a\"b\\", "tags": ["x", "y\u00e9"], "ok": true, "none": null,)"
+        R"( "pos": [-1.5e3, 0, 18446744073709551615], "nested": {"k": [{}, [], false]}})";
+    const char replacements[] = { ' ', '"', '\\', '{', '}', '[', ']', ':', ',', '1', 'x', '\0' };
+    for (size_t k = 0; k < document.size(); k++) {
+        for (char ch : replacements) {
+            string input = document;
+            input[k] = ch;
+            check_engines(input);
+        }
+        check_engines(document.substr(0, k));
+        check_engines(document.substr(0, k) + document.substr(k + 1));
+    }
+}
+
+
+// Return the message of the JsonException thrown by body, or "" if there is none.
+template <class F>
+static string exception_message(F &&body) {
+    try {
+        body();
+    } catch (const JsonException &err) {
+        return err.what();
+    }
+    return "";
+}
+
+// Check that a lazy value reads the same as the corresponding parsed value.
+static void check_lazy(const JsonLazyValue &lazy, const Json &json) {
+    JSON11_TEST_ASSERT(lazy.type() == json.type());
+    JSON11_TEST_ASSERT(lazy.decode() == json);
+    switch (json.type()) {
+    case Json::NUMBER:
+        JSON11_TEST_ASSERT(lazy.number_value() == json.number_value());
+        JSON11_TEST_ASSERT(lazy.int64_value() == json.int64_value());
+        JSON11_TEST_ASSERT(lazy.uint64_value() == json.uint64_value());
+        break;
+    case Json::BOOL:
+        JSON11_TEST_ASSERT(lazy.bool_value() == json.bool_value());
+        break;
+    case Json::STRING:
+        JSON11_TEST_ASSERT(lazy.string_value() == json.string_value());
+        break;
+    case Json::ARRAY: {
+        JSON11_TEST_ASSERT(lazy.size() == json.array_items().size());
+        size_t i = 0;
+        for (const JsonLazyValue element : lazy.array_items()) {
+            check_lazy(element, json[i]);
+            check_lazy(lazy[i], json[i]);
+            i++;
+        }
+        JSON11_TEST_ASSERT(exception_message([&] { lazy[i]; }) == "index out of bounds");
+        break;
+    }
+    case Json::OBJECT: {
+        JSON11_TEST_ASSERT(lazy.size() == json.object_items().size());
+        for (const JsonLazyValue member : lazy.object_items()) {
+            check_lazy(member, json[member.key()]);
+            check_lazy(lazy[member.key()], json[member.key()]);
+        }
+        break;
+    }
+    case Json::NUL:
+        break;
+    }
+}
+
+JSON11_TEST_CASE(json11_test_lazy_document) {
+    const string input = R"({"id": 18446744073709551615, "user": {"name": "a\"bé", "x": 23},)"
+                         R"( "tags": ["x", "y", [], {}], "ok": true, "none": null, "pi": -3.25e0,)"
+                         "\n\t\"pad\" : [ 1 , 2 ] }";
+    JsonLazyDocument doc;
+    string err;
+    JSON11_TEST_ASSERT(doc.parse(input, err));
+    const JsonLazyValue root = doc.root();
+
+    JSON11_TEST_ASSERT(root["id"].uint64_value() == 18446744073709551615u);
+    JSON11_TEST_ASSERT(root["user"]["name"].string_value() == "a\"b\xc3\xa9");
+    JSON11_TEST_ASSERT(root.get<int>("pi") == -3);
+    JSON11_TEST_ASSERT(root["user"].as<FooBar>().x == 23);
+    JSON11_TEST_ASSERT(root["tags"][1].as<string>() == "y");
+    JSON11_TEST_ASSERT(root["tags"][2].is_array() && root["tags"][2].size() == 0);
+    JSON11_TEST_ASSERT(root["ok"].bool_value() && root["none"].is_null());
+    JSON11_TEST_ASSERT(JsonLazyValue().is_null());
+    JSON11_TEST_ASSERT(root["tags"].text() == R"(["x", "y", [], {}])");
+    JSON11_TEST_ASSERT(root["pi"].text() == "-3.25e0");
+    JSON11_TEST_ASSERT(root["pad"][1].text() == "2");
+    JSON11_TEST_ASSERT(root["pad"].key() == "pad");
+    check_lazy(root, Json::parse(input, err));
+
+    // Accessors throw as Json's do.
+    JSON11_TEST_ASSERT(exception_message([&] { root["missing"]; }) == "invalid key");
+    JSON11_TEST_ASSERT(exception_message([&] { root["tags"][4]; }) == "index out of bounds");
+    JSON11_TEST_ASSERT(exception_message([&] { root["id"]["x"]; }) == "not an object");
+    JSON11_TEST_ASSERT(exception_message([&] { root["id"][0]; }) == "not an array");
+    JSON11_TEST_ASSERT(exception_message([&] { root["ok"].string_value(); }) == "not a string");
+    JSON11_TEST_ASSERT(exception_message([&] { root["tags"].number_value(); }) == "not a number");
+    JSON11_TEST_ASSERT(exception_message([&] { root["pi"].bool_value(); }) == "not a bool");
+    JSON11_TEST_ASSERT(exception_message([&] { root.key(); }) == "not an object member");
+
+    // Malformed input is only found where it is read.
+    const string broken = R"({"a": [1, 2x], "b": tru, "c": "\q", "d" 1, "e": 5})";
+    JSON11_TEST_ASSERT(doc.parse(broken, err));
+    const JsonLazyValue bad = doc.root();
+    JSON11_TEST_ASSERT(bad["a"].is_array() && bad["a"][0].int_value() == 1);
+    JSON11_TEST_ASSERT(exception_message([&] { bad["a"][1].int_value(); })
+                       == "unexpected 'x' (120) after value");
+    JSON11_TEST_ASSERT(exception_message([&] { bad["b"].bool_value(); })
+                       == "parse error: expected true, got tru,");
+    JSON11_TEST_ASSERT(exception_message([&] { bad["c"].string_value(); })
+                       == "invalid escape character 'q' (113)");
+    JSON11_TEST_ASSERT(exception_message([&] { bad["e"]; })
+                       == "expected ':' in object, got '1' (49)");
+    JSON11_TEST_ASSERT(exception_message([&] { bad.decode(); }) == "expected ',' in list, got 'x' (120)");
+    JSON11_TEST_ASSERT(doc.parse("[1, 2, ]", err));
+    JSON11_TEST_ASSERT(exception_message([&] { doc.root().size(); }) == "expected value, got ']' (93)");
+    JSON11_TEST_ASSERT(doc.parse("[1, [2, 3] 4]", err));
+    JSON11_TEST_ASSERT(doc.root()[1].size() == 2);
+    JSON11_TEST_ASSERT(exception_message([&] { doc.root()[2]; }) == "expected ',' in list, got '4' (52)");
+
+    // Structure is checked when the document is parsed.
+    const struct {
+        const char * input;
+        const char * err;
+    } failures[] = {
+        { "", "unexpected end of input" },
+        { "  ", "unexpected end of input" },
+        { "[\"abc]", "unexpected end of input in string" },
+        { "[1, {2]}", "unexpected ']' (93)" },
+        { "]", "unexpected ']' (93)" },
+        { "[[1]", "unexpected end of input" },
+        { "[1] [2]", "unexpected trailing '[' (91)" },
+        { "1 2", "unexpected trailing '2' (50)" },
+    };
+    for (const auto &failure : failures) {
+        JSON11_TEST_ASSERT(!doc.parse(failure.input, err));
+        JSON11_TEST_ASSERT(err == failure.err);
+        JSON11_TEST_ASSERT(doc.root().is_null());
+    }
+
+    // Documents spanning several index blocks, with strings across block boundaries.
+    for (size_t len = 0; len < 140; len += 7) {
+        const string text(len, 'a');
+        const string nested = "{\"" + text + "\": [\"" + text + "\\\\\", {\"k\\\"\": 1}], \"n\": "
+                            + std::to_string(len) + "}";
+        JSON11_TEST_ASSERT(doc.parse(nested, err));
+        check_lazy(doc.root(), Json::parse(nested, err));
+    }
+}
+
+JSON11_TEST_CASE(json11_test_projection) {
+    const string input = R"({"user": {"id": 7, "name": "x"}, "events": [{"ts": 1, "kind": "a"},)"
+                         R"( {"ts": 2}, {"kind": "b"}], "other": [1, {"deep": [2]}], "a/b": 3,)"
+                         R"( "m~n": 4, "user": {"id": 8}})";
+    const struct {
+        std::initializer_list<std::string_view> pointers;
+        const char * expected;
+    } cases[] = {
+        { { "/user/id", "/events/*/ts" }, R"({"user": {"id": 8}, "events": [{"ts": 1}, {"ts": 2}, {}]})" },
+        { { "/events/1" }, R"({"events": [{"ts": 2}]})" },
+        { { "/events/*/ts", "/events/0/kind" }, R"({"events": [{"ts": 1, "kind": "a"}, {"ts": 2}, {}]})" },
+        { { "/user", "/user/id/x" }, R"({"user": {"id": 8}})" },
+        { { "/user/id/x", "/missing" }, R"({"user": {}})" },
+        { { "/a~1b", "/m~0n" }, R"({"a/b": 3, "m~n": 4})" },
+        { { "/*/1" }, R"({"user": {}, "events": [{"ts": 2}], "other": [{"deep": [2]}]})" },
+        { { "/other/1/deep/0", "/other/0" }, R"({"other": [1, {"deep": [2]}]})" },
+        { {}, "{}" },
+    };
+    string err;
+    for (const auto &test : cases) {
+        const Json json = Json::parse(input, JsonProjection(test.pointers), err);
+        JSON11_TEST_ASSERT(err.empty());
+        JSON11_TEST_ASSERT(json.dump() == test.expected);
+    }
+
+    // The empty pointer selects everything.
+    JSON11_TEST_ASSERT(Json::parse(input, JsonProjection { "" }, err) == Json::parse(input, err));
+    JSON11_TEST_ASSERT(Json::parse("[1, 2]", JsonProjection { "/x" }, err).dump() == "[]");
+    JSON11_TEST_ASSERT(Json::parse("5", JsonProjection { "/x" }, err).is_null());
+    JSON11_TEST_ASSERT(Json::parse("5", JsonProjection { "" }, err) == 5);
+
+    // Dropped parts are still checked.
+    const string inputs[] = {
+        R"({"user": {"id": 1}, "other": [1, 2x]})", R"({"user": {"id": 1}, "other": "\q"})",
+        R"({"other": [1, {"a" 2}], "user": 1})", R"({"user": 1} x)", R"({"user": [)",
+        "{\"other\": \"\x01\"}", R"({"other": [)" + string(300, '[') + "]]}",
+    };
+    for (const auto &bad : inputs) {
+        string expected_err;
+        JSON11_TEST_ASSERT(Json::parse(bad, JsonProjection { "/user" }, err).is_null());
+        Json::parse(bad, expected_err);
+        JSON11_TEST_ASSERT(!err.empty() && err == expected_err);
+    }
+
+    // Comments are skipped in dropped parts too.
+    const Json commented = Json::parse("{/* \"x\": [ */ \"x\": [1, // ]\n 2], \"y\": 3}",
+                                       JsonProjection { "/x/1" }, err, COMMENTS);
+    JSON11_TEST_ASSERT(commented.dump() == R"({"x": [2]})");
+
+    // Duplicate keys are resolved among the kept members.
+    JsonParseOptions reject;
+    reject.duplicate_keys = REJECT_DUPLICATES;
+    JSON11_TEST_ASSERT(Json::parse(input, JsonProjection { "/events" }, err, reject).dump()
+                       == R"({"events": [{"ts": 1, "kind": "a"}, {"ts": 2}, {"kind": "b"}]})");
+    JSON11_TEST_ASSERT(Json::parse(input, JsonProjection { "/user/id" }, err, reject).is_null());
+    JSON11_TEST_ASSERT(err == "duplicate key \"user\" in object");
+
+    const string bad_pointers[] = { "user", "/a~2", "/a~" };
+    for (const auto &pointer : bad_pointers) {
+        bool thrown = false;
+        try {
+            JsonProjection projection { pointer };
+        } catch (const JsonException &) {
+            thrown = true;
+        }
+        JSON11_TEST_ASSERT(thrown);
+    }
+}
+
+JSON11_TEST_CASE(json11_test_validate) {
+    // validate accepts and rejects exactly what parse does.
+    const string inputs[] = {
+        R"({"k1":"v1", "k2":42, "k3":["a",123,true,false,null]})",
+        R"([ "blah\ud83d\udca9blah\ud83dblah\udca9blah\u0000blah\u1234" ])",
+        R"(["\b\f\n\r\t\"\\\/", "\u00E9", -0.5e-3, 18446744073709551616, 1E400])",
+        "\"\\u12\"", "\"\\u12g4\"", "\"\\x\"", "\"abc\\", "\"a\x01\"", "[1, 2x]", "[1] x", "01",
+        "1.", "-", "tru", "[1,]", "{\"a\" 1}", "{\"a\": 1,}", "", "  ", "[", "{\"a\":",
+        "/* c */ [1, // c\n 2] /* c */", "[1 /* c", "[1] /", "{\"a\" /* c */ : 1}",
+        string(200, '[') + string(200, ']'), string(201, '[') + string(201, ']'),
+        "\"" + string(100, 'a') + "\\n" + string(100, 'b') + "\"",
+    };
+    for (const auto &input : inputs) {
+        for (JsonParse strategy : { JsonParse::STANDARD, JsonParse::COMMENTS }) {
+            string err, expected_err;
+            Json::parse(input, expected_err, strategy);
+            JSON11_TEST_ASSERT(Json::validate(input, err, strategy) == expected_err.empty());
+            JSON11_TEST_ASSERT(err == expected_err);
+        }
+    }
+
+    string err;
+    size_t pos = 0;
+    JSON11_TEST_ASSERT(!Json::validate("[1, 2x]", err, pos));
+    JSON11_TEST_ASSERT(err == "expected ',' in list, got 'x' (120)" && pos == 6);
+    JSON11_TEST_ASSERT(!Json::validate("[1] x", err, pos));
+    JSON11_TEST_ASSERT(err == "unexpected trailing 'x' (120)" && pos == 4);
+    // Input that ends where a value should start stops at its end.
+    for (const string truncated : { "[", "[1,", "[1, ", "{\"a\": 1,", "{\"a\":" }) {
+        JSON11_TEST_ASSERT(!Json::validate(truncated, err, pos));
+        JSON11_TEST_ASSERT(err == "unexpected end of input" && pos == truncated.size());
+    }
+    JSON11_TEST_ASSERT(!Json::validate("[\"ab\\q\"]", err, pos));
+    JSON11_TEST_ASSERT(err == "invalid escape character 'q' (113)" && pos == 6);
+}
+
+JSON11_TEST_CASE(json11_test_max_depth) {
+    // The default limit is unchanged.
+    string err;
+    Json::parse(string(201, '[') + string(201, ']'), err);
+    JSON11_TEST_ASSERT(err.empty());
+    Json::parse(string(202, '[') + string(202, ']'), err);
+    JSON11_TEST_ASSERT(err == "exceeded maximum nesting depth");
+
+    // A custom limit applies to both engines, to handlers and to validate.
+    JsonParseOptions options;
+    options.max_depth = 2;
+    const string within = R"({"a": [1, {}]})", beyond = R"({"a": [{"b": 1}]})";
+    for (JsonParseEngine engine : { RECURSIVE_DESCENT, STRUCTURAL_INDEX }) {
+        options.engine = engine;
+        err.clear();
+        Json::parse(within, err, options);
+        JSON11_TEST_ASSERT(err.empty());
+        Json::parse(beyond, err, options);
+        JSON11_TEST_ASSERT(err == "exceeded maximum nesting depth");
+    }
+    EventLog log;
+    JSON11_TEST_ASSERT(!Json::parse(beyond, log, err, options));
+    JSON11_TEST_ASSERT(err == "exceeded maximum nesting depth");
+    JSON11_TEST_ASSERT(Json::validate(within, err, options));
+    JSON11_TEST_ASSERT(!Json::validate(beyond, err, options));
+    JSON11_TEST_ASSERT(err == "exceeded maximum nesting depth");
+
+    // Levels past the inline part of the nesting stack are added once, however many sibling
+    // containers enter them.
+    struct CountingResource final : std::pmr::memory_resource {
+        size_t bytes = 0;
+        void *do_allocate(size_t size, size_t align) override {
+            bytes += size;
+            return std::pmr::new_delete_resource()->allocate(size, align);
+        }
+        void do_deallocate(void *p, size_t size, size_t align) override {
+            std::pmr::new_delete_resource()->deallocate(p, size, align);
+        }
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+    } counting;
+    string siblings = string(256, '[');
+    for (int i = 0; i < 10000; i++)
+        siblings += "[0], ";
+    siblings += "[0]" + string(256, ']');
+    options.max_depth = 1000;
+    std::pmr::memory_resource * const previous = std::pmr::set_default_resource(&counting);
+    const bool valid = Json::validate(siblings, err, options);
+    std::pmr::set_default_resource(previous);
+    JSON11_TEST_ASSERT(valid);
+    JSON11_TEST_ASSERT(counting.bytes <= 64);
+
+    // Raised limits do not run out of call stack while parsing.
+    options.max_depth = 1000000;
+    string deep;
+    for (int i = 0; i < 1000000; i++)
+        deep += i % 2 ? "[" : "{\"a\":";
+    deep += "null";
+    for (int i = 1000000; i-- > 0;)
+        deep += i % 2 ? "]" : "}";
+    JSON11_TEST_ASSERT(Json::validate(deep, err, options));
+    JSON11_TEST_ASSERT(!Json::validate(deep.substr(0, deep.size() - 1), err, options));
+    JSON11_TEST_ASSERT(err == "unexpected end of input");
+    for (JsonParseEngine engine : { RECURSIVE_DESCENT, STRUCTURAL_INDEX }) {
+        options.engine = engine;
+        const string nested = string(5000, '[') + "1" + string(5000, ']');
+        err.clear();
+        const Json json = Json::parse(nested, err, options);
+        JSON11_TEST_ASSERT(err.empty() && json.dump() == nested);
+    }
+}
 
 #if JSON11_TEST_STANDALONE_MAIN
 
@@ -326,6 +1416,30 @@ int main(int argc, char **argv) {
 
     // json11_test();
     json11_test_geode();
+    json11_test_value_semantics();
+    json11_test_document();
+    json11_test_memory_resource();
+    json11_test_object_parsing();
+    json11_test_object_index();
+    json11_test_string_view_lookup();
+    json11_test_unterminated_input();
+    json11_test_whitespace();
+    json11_test_string_scanning();
+    json11_test_number_parsing();
+    json11_test_64bit_integers();
+    json11_test_double_dump();
+    json11_test_writer();
+    json11_test_string_escaping();
+    json11_test_dump_options();
+    json11_test_dump_sinks();
+    json11_test_dump_size();
+    json11_test_event_parsing();
+    json11_test_stream_parsing();
+    json11_test_structural_index();
+    json11_test_lazy_document();
+    json11_test_projection();
+    json11_test_validate();
+    json11_test_max_depth();
 }
 
 #endif // JSON11_TEST_STANDALONE_MAIN